@@ -0,0 +1,57 @@
+#ifndef __COMPUTING_CACHE_H__
+#define __COMPUTING_CACHE_H__
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Result cache (hls_computing -cache <dir>). An encoded output is kept as
+ * <dir>/<key>.webp, the key a hash of the input bytes and of everything
+ * else that changes the output. Once a store takes the cache over its size
+ * the least recently used entries are removed. The use order is the mtime
+ * of the files, a hit touches its entry, so it survives a restart. All
+ * calls are thread safe.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 64-bit hash of 'len' bytes (the XXH64 algorithm), words read in host
+   byte order. */
+uint64_t computing_cache_hash(const void *data, size_t len, uint64_t seed);
+
+/* Opens or creates the cache in 'dir', at most 'max_bytes' of outputs.
+   Returns 0, or -1 with errno set. */
+int computing_cache_open(const char *dir, uint64_t max_bytes);
+void computing_cache_close(int verbose);
+
+/* The output stored for 'key' in a malloc()ed buffer of *len bytes, or
+   NULL on a miss. */
+void *computing_cache_get(uint64_t key, size_t *len);
+/* Stores the output of 'n' chunks for 'key', unless it is there already.
+   Returns 0, or -1. */
+int computing_cache_put(uint64_t key, const struct iovec *iov, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* __COMPUTING_CACHE_H__ */
@@ -0,0 +1,46 @@
+#ifndef __COMPUTING_CPU_H__
+#define __COMPUTING_CPU_H__
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * One job of the computing action run on the calling thread. Same
+ * input layout, same kernel and same macroblock order as the card, so
+ * the DATA_O records match the FPGA bit for bit. Used by the software
+ * action and by the hosts to share the load with the cards.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct DATA_O;
+
+/* Returns 0, or -1 on bad arguments or out of memory. */
+int computing_cpu_run(const uint8_t *in, struct DATA_O *out,
+		      int mb_w, int mb_h);
+/* Same result, the macroblock rows spread over 'threads' threads. */
+int computing_cpu_run_rows(const uint8_t *in, struct DATA_O *out,
+			   int mb_w, int mb_h, int threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* __COMPUTING_CPU_H__ */
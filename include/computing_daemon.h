@@ -0,0 +1,68 @@
+#ifndef __COMPUTING_DAEMON_H__
+#define __COMPUTING_DAEMON_H__
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Encode daemon (hls_computing -daemon <socket>). Keeps the cards, the
+ * buffer pool and the encoder tables up and serves requests on a Unix
+ * stream socket, any number of clients, one request at a time per
+ * connection. Only the user running the daemon can connect. All fields
+ * are in host byte order; quality is 0 to 100, else -EINVAL.
+ *
+ *   client: struct computing_request, then in_len bytes (the picture
+ *           file, or its path), then out_len bytes (output path, or
+ *           nothing to get the WebP file back)
+ *   daemon: struct computing_reply, then len bytes (the WebP file when
+ *           no output path was given, the text for COMPUTING_OP_STATS)
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COMPUTING_DAEMON_MAGIC	0x43505457	/* "WTPC" */
+
+#define COMPUTING_OP_ENCODE	0	/* picture bytes follow */
+#define COMPUTING_OP_ENCODE_PATH 1	/* path of the picture follows */
+#define COMPUTING_OP_STATS	2	/* latency statistics as text */
+
+struct computing_request {
+	uint32_t magic;
+	uint32_t op;
+	float quality;
+	uint32_t in_len;
+	uint32_t out_len;
+};
+
+struct computing_reply {
+	uint32_t magic;
+	int32_t status;		/* 0, or -errno */
+	uint32_t len;
+	uint32_t usec;		/* time spent in the daemon */
+};
+
+/* Serves until SIGINT or SIGTERM. The encoder must be running. */
+int computing_daemon_run(const char *path, int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* __COMPUTING_DAEMON_H__ */
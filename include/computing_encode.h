@@ -0,0 +1,76 @@
+#ifndef __COMPUTING_ENCODE_H__
+#define __COMPUTING_ENCODE_H__
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * WebP encoder of hls_computing as a library (libcomputing.a, make
+ * libcomputing.a in sw/). The pipeline is started once; after that any
+ * number of threads may encode pictures into memory concurrently. Each
+ * call runs the analysis on the calling thread, queues the macroblock
+ * work on the backend and returns once the WebP file is complete.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Where the macroblock decisions are computed */
+#define COMPUTING_BACKEND_SNAP		0	/* OpenCAPI cards, plus cpu_threads */
+#define COMPUTING_BACKEND_EMULATED	1	/* the software action, SNAP_CONFIG=CPU */
+#define COMPUTING_BACKEND_CPU		2	/* host threads only */
+
+struct computing_options {
+	int backend;
+	int card_no;		/* -1: every card found */
+	int cpu_threads;	/* host threads beside the cards */
+	int cpu_rows;		/* threads on the rows of one picture */
+	int emit_threads;	/* token/bitstream workers */
+	int depth;		/* jobs queued per card */
+	int pool_mb;		/* DMA buffers kept for reuse */
+	int hugepage;
+	int sharp_yuv;		/* iterative RGB to YUV, sharper and slower */
+	int sharp_threads;	/* threads on one picture for sharp_yuv */
+};
+
+void computing_options_default(struct computing_options *options);
+
+/* Returns 0, or -1 if no backend could be started. NULL: defaults. */
+int computing_encoder_init(const struct computing_options *options);
+/* Waits for the pictures in flight and stops the pipeline. */
+void computing_encoder_close(void);
+
+/*
+ * Both return the size of the WebP file stored in *output, or 0 on
+ * error. 'quality' is that of cwebp -q, 0 to 100; anything else is an
+ * error. Free *output with computing_encode_free().
+ */
+size_t computing_encode_rgba(const uint8_t *rgba, int width, int height,
+			     int stride, float quality, uint8_t **output);
+/* 'data' is a complete PNG or JPEG file */
+size_t computing_encode_image(const uint8_t *data, size_t data_size,
+			      float quality, uint8_t **output);
+void computing_encode_free(uint8_t *output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* __COMPUTING_ENCODE_H__ */
@@ -0,0 +1,75 @@
+#ifndef __COMPUTING_PACK_H__
+#define __COMPUTING_PACK_H__
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Pack files (hls_computing -pack <prefix>). The WebP files of a run are
+ * appended to <prefix>-0000.pack, -0001.pack, ... and every pack gets an
+ * index next to it, <prefix>-NNNN.idx, meant to be mmap()ed as is:
+ *
+ *   struct computing_pack_header
+ *   struct computing_pack_entry[count], sorted by name
+ *   the names, NUL terminated, 'names' bytes
+ *
+ * All fields are in host byte order.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COMPUTING_PACK_MAGIC	0x58495043	/* "CPIX" */
+#define COMPUTING_PACK_VERSION	1
+
+struct computing_pack_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t names;
+};
+
+struct computing_pack_entry {
+	uint64_t offset;	/* in the .pack file */
+	uint32_t length;
+	uint32_t name;		/* offset in the names */
+};
+
+/* Writes the index of 'count' entries, sorted in place, atomically to
+   'path'. Returns 0, or -1 with errno set. */
+int computing_pack_write_index(const char *path,
+			       struct computing_pack_entry *entry,
+			       uint32_t count, const char *names,
+			       uint32_t names_len);
+
+/* Checks a mapped index. Returns 0, or -1 if it is not one. */
+int computing_pack_check(const void *index, size_t size);
+/* Name of an entry of a checked index */
+const char *computing_pack_name(const void *index,
+				const struct computing_pack_entry *e);
+/* Binary search of a checked index, NULL if 'name' is not in it. */
+const struct computing_pack_entry *computing_pack_find(const void *index,
+							const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* __COMPUTING_PACK_H__ */
@@ -0,0 +1,45 @@
+#ifndef __COMPUTING_POOL_H__
+#define __COMPUTING_POOL_H__
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Recycled host buffers for the action. Buffers are page aligned,
+ * pre-faulted and grouped into size classes (four per power of two);
+ * a freed buffer goes back to its class and is handed out again to the
+ * next request of that class, without being cleared.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* max_cached: bytes kept in the free lists, hugepage: back buffers of
+   2 MiB and more with huge pages when the system has some. */
+void computing_pool_init(size_t max_cached, int hugepage);
+void *computing_pool_alloc(size_t size);
+void computing_pool_free(void *buf);
+/* Unmaps every cached buffer; verbose prints the hit count. */
+void computing_pool_fini(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* __COMPUTING_POOL_H__ */
@@ -0,0 +1,49 @@
+#ifndef __COMPUTING_QUEUE_H__
+#define __COMPUTING_QUEUE_H__
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Bounded multi-producer/multi-consumer queue of pointers between the
+ * stages of the host pipeline. The ring itself is lock-free; push blocks
+ * while the queue is full, which throttles the producing stage, and pop
+ * blocks while it is empty.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct computing_queue;
+
+struct computing_queue *computing_queue_alloc(unsigned int depth);
+void computing_queue_free(struct computing_queue *q);
+
+/* Returns 0, or -1 once the queue is closed. */
+int computing_queue_push(struct computing_queue *q, void *item);
+/* Returns NULL once the queue is closed and drained. */
+void *computing_queue_pop(struct computing_queue *q);
+/* Non-blocking pop, NULL when the queue is empty. */
+void *computing_queue_trypop(struct computing_queue *q);
+/* No more pushes; consumers drain what is left and then get NULL. */
+void computing_queue_close(struct computing_queue *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* __COMPUTING_QUEUE_H__ */
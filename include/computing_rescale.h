@@ -0,0 +1,42 @@
+#ifndef __COMPUTING_RESCALE_H__
+#define __COMPUTING_RESCALE_H__
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Rescaler of 8-bit planes for resize-on-ingest. Every destination
+ * sample is the area weighted average of the source samples it covers,
+ * in 14-bit fixed point, so shrinking by any ratio neither aliases nor
+ * drops rows; enlarging blends the two nearest samples at the seams.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns 0, or -1 on allocation failure. */
+int computing_rescale_plane(const uint8_t *src, int src_w, int src_h,
+			    int src_stride, uint8_t *dst, int dst_w,
+			    int dst_h, int dst_stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* __COMPUTING_RESCALE_H__ */
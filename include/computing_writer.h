@@ -0,0 +1,71 @@
+#ifndef __COMPUTING_WRITER_H__
+#define __COMPUTING_WRITER_H__
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Output stage of the host pipeline. An output file is collected as a
+ * list of chunks and handed to a single writer thread, which opens the
+ * file, writes the chunks with writev() and closes it. Large chunks are
+ * referenced, not copied: the writer releases them once they are on disk.
+ * The encoder threads never block on the file system, only on the queue
+ * in front of the writer when it is full.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct computing_out;
+
+/* Pack mode: the outputs are appended to pack files named after 'prefix',
+   a new one once a pack would grow beyond 'rotate' bytes (0: never), see
+   computing_pack.h. The path of an output is its name in the index. Call
+   before computing_writer_start(); NULL goes back to one file each. */
+int computing_writer_pack(const char *prefix, size_t rotate);
+/* At most 'depth' outputs wait for the writer. With sync_batch > 0 the
+   written files are fsync'ed in groups of up to sync_batch, or as soon as
+   the writer runs out of work. Returns 0, or -1 on failure. */
+int computing_writer_start(unsigned int depth, int sync_batch);
+/* Writes what is queued and stops the writer. Returns the number of
+   outputs that could not be written. */
+int computing_writer_stop(int verbose);
+
+/* An empty output for 'path'; nothing is created before it is written. */
+struct computing_out *computing_out_new(const char *path);
+/* Appends a copy of data. Returns 0, or -1 on allocation failure. */
+int computing_out_copy(struct computing_out *o, const void *data, size_t len);
+/* Appends data by reference, release(data) is called once it is written
+   or discarded, also if this call fails. Returns 0, or -1. */
+int computing_out_take(struct computing_out *o, void *data, size_t len,
+		       void (*release)(void *));
+/* The writer also stores the output in the result cache under 'key',
+   see computing_cache.h. */
+void computing_out_cache(struct computing_out *o, uint64_t key);
+/* Queues the output for the writer. */
+void computing_out_submit(struct computing_out *o);
+/* Drops an output that will not be written. */
+void computing_out_discard(struct computing_out *o);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* __COMPUTING_WRITER_H__ */
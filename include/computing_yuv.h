@@ -0,0 +1,83 @@
+#ifndef __COMPUTING_YUV_H__
+#define __COMPUTING_YUV_H__
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * RGB to YUV 4:2:0 row kernels of the picture import and of the sharp
+ * (iterative) conversion, with the arithmetic of the libwebp C code. The
+ * pointers start out at the C versions, computing_yuv_init() moves them
+ * to the SSE4.1 or AVX2 ones the cpu has. Every version gives the same
+ * bytes.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum computing_yuv_impl {
+	COMPUTING_YUV_C = 0,
+	COMPUTING_YUV_SSE41,
+	COMPUTING_YUV_AVX2,
+};
+
+/* Selects the best kernels up to 'max' the cpu supports and returns
+   which ones. Call before the kernels are in use. */
+int computing_yuv_init(int max);
+const char *computing_yuv_name(int impl);
+
+/* Y of 'width' pixels of 'step' bytes (3 or 4), in R, G, B order or in
+   B, G, R order with 'swap_rb'. */
+extern void (*computing_rgb_to_y)(const uint8_t *rgb, int step, int swap_rb,
+				  uint8_t *y, int width);
+/* Gamma corrected R, G, B averages of the 2x2 blocks of two rows
+   'stride' apart (0: the row twice), into (width + 1) / 2 entries of 4
+   values. The 4th value of an entry is not used. */
+extern void (*computing_rgb_accumulate)(const uint8_t *rgb, int step,
+					int swap_rb, int stride,
+					uint16_t *dst, int width);
+/* U and V of 'width' entries of computing_rgb_accumulate(). */
+extern void (*computing_rgb_to_uv)(const uint16_t *rgb, uint8_t *u,
+				   uint8_t *v, int width);
+
+/*
+ * Sharp conversion, on its 10-bit W (luma) values and signed R-W, G-W,
+ * B-W values. W inputs must be in 0..1023.
+ */
+/* dst[i] += ref[i] - src[i] clipped to 0..1023, returns the sum of the
+   absolute differences */
+extern uint64_t (*computing_sharp_update_y)(const uint16_t *ref,
+					    const uint16_t *src,
+					    uint16_t *dst, int len);
+/* dst[i] += ref[i] - src[i] */
+extern void (*computing_sharp_update_rgb)(const int16_t *ref,
+					  const int16_t *src,
+					  int16_t *dst, int len);
+/* 2 * len samples of the chroma rows 'a' (this one) and 'b' (the
+   neighbour) upsampled 2x with 9-3-3-1 weights, added to best_y and
+   clipped to 0..1023. Reads a[0..len] and b[0..len]. */
+extern void (*computing_sharp_filter_row)(const int16_t *a, const int16_t *b,
+					  int len, const uint16_t *best_y,
+					  uint16_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* __COMPUTING_YUV_H__ */
@@ -34,12 +34,17 @@
 #include <snap_internal.h>
 #include <snap_tools.h>
 #include <computing_common.h>
+#include <computing_cpu.h>
 
 static int mmio_write32(struct snap_card *card,
 			uint64_t offs, uint32_t data)
 {
 	act_trace("  %s(%p, %llx, %x)\n", __func__, card,
 		  (long long)offs, data);
+	/* act_trace() may compile to nothing */
+	(void)card;
+	(void)offs;
+	(void)data;
 	return 0;
 }
 
@@ -48,18 +53,43 @@ static int mmio_read32(struct snap_card *card,
 {
 	act_trace("  %s(%p, %llx, %x)\n", __func__, card,
 		  (long long)offs, *data);
+	(void)card;
+	(void)offs;
+	(void)data;
 	return 0;
 }
 
-/* Main program of the software action */
+/* Main program of the software action, see computing_cpu_run() */
 static int action_main(struct snap_sim_action *action,
 		       void *job, unsigned int job_len)
 {
-	(void)action;
-	(void)job;
-	(void)job_len;
+	struct computing_job *js = (struct computing_job *)job;
+	uint8_t *din;
+	DATA_O *dout;
+	int mb_w, mb_h;
+
+	if (job_len < sizeof(*js)) {
+		act_trace("  %s: job too small (%u)\n", __func__, job_len);
+		goto out_err;
+	}
+
+	din = (uint8_t *)(unsigned long)js->in;
+	dout = (DATA_O *)(unsigned long)js->out;
+	mb_w = js->mb_w_h & 0x0000FFFF;
+	mb_h = js->mb_w_h >> 16;
+	act_trace("  %s: in=%p out=%p mb_w=%d mb_h=%d\n", __func__,
+		  din, dout, mb_w, mb_h);
+
+	/* The boundary memories of the hardware hold 1024 macroblocks */
+	if (mb_w > 1024 || computing_cpu_run(din, dout, mb_w, mb_h) != 0)
+		goto out_err;
+
+	action->job.retc = SNAP_RETC_SUCCESS;
 	return 0;
 
+ out_err:
+	action->job.retc = SNAP_RETC_FAILURE;
+	return 0;
 }
 
 /* This is the switch call when software action is called */
@@ -0,0 +1,490 @@
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Result cache, see computing_cache.h.
+ *
+ * The entries are in a hash table on the key and on a list in use order,
+ * most recent first. Only the lookups and the list are under the lock,
+ * the files are read and written outside of it: a store goes to a
+ * temporary file that is renamed into place, so a reader never sees a
+ * partial output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <computing_cache.h>
+
+#define P1	11400714785074694791ULL
+#define P2	14029467366897019727ULL
+#define P3	1609587929392839161ULL
+#define P4	9650029242287828579ULL
+#define P5	2870177450012600261ULL
+
+#define CACHE_NAME_LEN	21	/* 16 hex digits and ".webp" */
+
+struct entry {
+	uint64_t key;
+	uint64_t size;
+	struct entry *chain;		/* same bucket */
+	struct entry *prev, *next;	/* use order */
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *cache_dir = NULL;
+static uint64_t cache_max = 0, cache_bytes = 0;
+static struct entry **table = NULL;
+static size_t table_size = 0, count = 0;
+static struct entry *head = NULL, *tail = NULL;
+static unsigned long tmp_no = 0;
+
+/* Counters, under the lock */
+static unsigned long hits = 0, misses = 0, stores = 0, evictions = 0;
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t in)
+{
+	acc += in * P2;
+	return rotl(acc, 31) * P1;
+}
+
+static inline uint64_t hash_merge(uint64_t h, uint64_t v)
+{
+	h ^= hash_round(0, v);
+	return h * P1 + P4;
+}
+
+uint64_t computing_cache_hash(const void *data, size_t len, uint64_t seed)
+{
+	const uint8_t *p = data;
+	const uint8_t *const end = p + len;
+	uint64_t h;
+
+	if (len >= 32) {
+		uint64_t v1 = seed + P1 + P2, v2 = seed + P2;
+		uint64_t v3 = seed, v4 = seed - P1;
+
+		do {
+			v1 = hash_round(v1, read64(p));
+			v2 = hash_round(v2, read64(p + 8));
+			v3 = hash_round(v3, read64(p + 16));
+			v4 = hash_round(v4, read64(p + 24));
+			p += 32;
+		} while (end - p >= 32);
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = hash_merge(h, v1);
+		h = hash_merge(h, v2);
+		h = hash_merge(h, v3);
+		h = hash_merge(h, v4);
+	} else {
+		h = seed + P5;
+	}
+	h += len;
+	for (; end - p >= 8; p += 8)
+		h = rotl(h ^ hash_round(0, read64(p)), 27) * P1 + P4;
+	if (end - p >= 4) {
+		h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+		p += 4;
+	}
+	for (; p < end; p++)
+		h = rotl(h ^ (*p * P5), 11) * P1;
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+	return h;
+}
+
+static void entry_path(char *path, size_t size, uint64_t key)
+{
+	snprintf(path, size, "%s/%016llx.webp", cache_dir,
+		 (unsigned long long)key);
+}
+
+/* The keys are hashes already, the low bits pick the bucket. */
+static struct entry **table_slot(uint64_t key)
+{
+	struct entry **e = &table[key & (table_size - 1)];
+
+	while (*e != NULL && (*e)->key != key)
+		e = &(*e)->chain;
+	return e;
+}
+
+static int table_grow(void)
+{
+	size_t size = table_size ? 2 * table_size : 1024;
+	struct entry **t = calloc(size, sizeof(*t));
+	size_t i;
+
+	if (t == NULL)
+		return -1;
+	for (i = 0; i < table_size; i++) {
+		while (table[i] != NULL) {
+			struct entry *e = table[i];
+
+			table[i] = e->chain;
+			e->chain = t[e->key & (size - 1)];
+			t[e->key & (size - 1)] = e;
+		}
+	}
+	free(table);
+	table = t;
+	table_size = size;
+	return 0;
+}
+
+static void list_unlink(struct entry *e)
+{
+	if (e->prev != NULL)
+		e->prev->next = e->next;
+	else
+		head = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	else
+		tail = e->prev;
+}
+
+static void list_push(struct entry *e)
+{
+	e->prev = NULL;
+	e->next = head;
+	if (head != NULL)
+		head->prev = e;
+	else
+		tail = e;
+	head = e;
+}
+
+/* Under the lock */
+static int entry_add(uint64_t key, uint64_t size)
+{
+	struct entry **slot;
+	struct entry *e;
+
+	if (count >= table_size && table_grow() != 0)
+		return -1;
+	slot = table_slot(key);
+	if (*slot != NULL)
+		return 0;
+	e = calloc(1, sizeof(*e));
+	if (e == NULL)
+		return -1;
+	e->key = key;
+	e->size = size;
+	*slot = e;
+	list_push(e);
+	count++;
+	cache_bytes += size;
+	return 0;
+}
+
+/* Under the lock; the file is left alone. */
+static void entry_remove(struct entry **slot)
+{
+	struct entry *e = *slot;
+
+	*slot = e->chain;
+	list_unlink(e);
+	count--;
+	cache_bytes -= e->size;
+	free(e);
+}
+
+/* Under the lock: drops the least recently used entries until the cache
+   fits, the newest one is always kept. */
+static void cache_evict(void)
+{
+	char path[4096];
+
+	while (cache_bytes > cache_max && tail != NULL && tail != head) {
+		entry_path(path, sizeof(path), tail->key);
+		unlink(path);
+		entry_remove(table_slot(tail->key));
+		evictions++;
+	}
+}
+
+struct scan {
+	uint64_t key;
+	uint64_t size;
+	time_t mtime;
+	long nsec;
+};
+
+static int scan_cmp(const void *a, const void *b)
+{
+	const struct scan *sa = a, *sb = b;
+
+	if (sa->mtime != sb->mtime)
+		return sa->mtime < sb->mtime ? -1 : 1;
+	if (sa->nsec != sb->nsec)
+		return sa->nsec < sb->nsec ? -1 : 1;
+	return 0;
+}
+
+/* Reads the entries of the cache directory, oldest first on the list, and
+   removes the temporary files a crashed run left behind. */
+static int cache_scan(void)
+{
+	struct scan *s = NULL;
+	size_t n = 0, max = 0, i;
+	struct dirent *d;
+	DIR *dir;
+
+	dir = opendir(cache_dir);
+	if (dir == NULL)
+		return -1;
+	while ((d = readdir(dir)) != NULL) {
+		const size_t len = strlen(d->d_name);
+		struct stat st;
+		char *end;
+		uint64_t key;
+
+		if (len > 4 && !strcmp(d->d_name + len - 4, ".tmp")) {
+			unlinkat(dirfd(dir), d->d_name, 0);
+			continue;
+		}
+		if (len != CACHE_NAME_LEN ||
+		    strcmp(d->d_name + 16, ".webp") != 0)
+			continue;
+		key = strtoull(d->d_name, &end, 16);
+		if (end != d->d_name + 16 ||
+		    fstatat(dirfd(dir), d->d_name, &st, 0) != 0 ||
+		    !S_ISREG(st.st_mode))
+			continue;
+		if (n == max) {
+			struct scan *t;
+
+			max = max ? 2 * max : 1024;
+			t = realloc(s, max * sizeof(*s));
+			if (t == NULL) {
+				closedir(dir);
+				free(s);
+				return -1;
+			}
+			s = t;
+		}
+		s[n].key = key;
+		s[n].size = st.st_size;
+		s[n].mtime = st.st_mtim.tv_sec;
+		s[n].nsec = st.st_mtim.tv_nsec;
+		n++;
+	}
+	closedir(dir);
+
+	qsort(s, n, sizeof(*s), scan_cmp);
+	for (i = 0; i < n; i++) {
+		if (entry_add(s[i].key, s[i].size) != 0) {
+			free(s);
+			return -1;
+		}
+	}
+	free(s);
+	return 0;
+}
+
+int computing_cache_open(const char *dir, uint64_t max_bytes)
+{
+	if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+		return -1;
+	pthread_mutex_lock(&cache_lock);
+	cache_dir = strdup(dir);
+	cache_max = max_bytes;
+	if (cache_dir == NULL || table_grow() != 0 || cache_scan() != 0) {
+		pthread_mutex_unlock(&cache_lock);
+		computing_cache_close(0);
+		errno = ENOMEM;
+		return -1;
+	}
+	cache_evict();
+	pthread_mutex_unlock(&cache_lock);
+	return 0;
+}
+
+void computing_cache_close(int verbose)
+{
+	pthread_mutex_lock(&cache_lock);
+	if (verbose && cache_dir != NULL)
+		fprintf(stderr, "cache: %lu hits, %lu misses, %lu stores, "
+			"%lu evictions, %zu entries, %llu bytes\n", hits,
+			misses, stores, evictions, count,
+			(unsigned long long)cache_bytes);
+	while (head != NULL)
+		entry_remove(table_slot(head->key));
+	free(table);
+	free(cache_dir);
+	table = NULL;
+	table_size = 0;
+	cache_dir = NULL;
+	cache_bytes = 0;
+	hits = misses = stores = evictions = 0;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+static void *read_entry(const char *path, size_t *len)
+{
+	struct stat st;
+	uint8_t *data = NULL;
+	size_t done = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+		goto fail;
+	data = malloc(st.st_size);
+	if (data == NULL)
+		goto fail;
+	while (done < (size_t)st.st_size) {
+		ssize_t r = read(fd, data + done, st.st_size - done);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			goto fail;
+		done += r;
+	}
+	/* the mtime is the use order on the next start */
+	futimens(fd, NULL);
+	close(fd);
+	*len = done;
+	return data;
+
+ fail:
+	free(data);
+	close(fd);
+	return NULL;
+}
+
+void *computing_cache_get(uint64_t key, size_t *len)
+{
+	char path[4096];
+	struct entry **slot;
+	void *data;
+
+	pthread_mutex_lock(&cache_lock);
+	if (cache_dir == NULL || *(slot = table_slot(key)) == NULL) {
+		misses++;
+		pthread_mutex_unlock(&cache_lock);
+		return NULL;
+	}
+	list_unlink(*slot);
+	list_push(*slot);
+	entry_path(path, sizeof(path), key);
+	pthread_mutex_unlock(&cache_lock);
+
+	data = read_entry(path, len);
+
+	pthread_mutex_lock(&cache_lock);
+	if (data != NULL) {
+		hits++;
+	} else {
+		/* removed behind our back, or evicted meanwhile */
+		slot = table_slot(key);
+		if (*slot != NULL)
+			entry_remove(slot);
+		misses++;
+	}
+	pthread_mutex_unlock(&cache_lock);
+	return data;
+}
+
+int computing_cache_put(uint64_t key, const struct iovec *iov, int n)
+{
+	char path[4096], tmp[4096 + 32];
+	uint64_t size = 0;
+	int fd, i;
+
+	pthread_mutex_lock(&cache_lock);
+	if (cache_dir == NULL || *table_slot(key) != NULL) {
+		pthread_mutex_unlock(&cache_lock);
+		return cache_dir == NULL ? -1 : 0;
+	}
+	entry_path(path, sizeof(path), key);
+	snprintf(tmp, sizeof(tmp), "%s.%lu.tmp", path, tmp_no++);
+	pthread_mutex_unlock(&cache_lock);
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+		return -1;
+	for (i = 0; i < n; i++) {
+		const uint8_t *p = iov[i].iov_base;
+		size_t left = iov[i].iov_len;
+
+		while (left > 0) {
+			ssize_t w = write(fd, p, left);
+
+			if (w < 0 && errno == EINTR)
+				continue;
+			if (w <= 0)
+				goto fail;
+			p += w;
+			left -= w;
+		}
+		size += iov[i].iov_len;
+	}
+	if (close(fd) != 0 || rename(tmp, path) != 0) {
+		unlink(tmp);
+		return -1;
+	}
+
+	pthread_mutex_lock(&cache_lock);
+	if (cache_dir != NULL && entry_add(key, size) == 0) {
+		stores++;
+		cache_evict();
+	}
+	pthread_mutex_unlock(&cache_lock);
+	return 0;
+
+ fail:
+	close(fd);
+	unlink(tmp);
+	return -1;
+}
@@ -0,0 +1,345 @@
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Macroblock loop of the computing action on the host.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <computing_common.h>
+#include <computing_kernel.h>
+#include <computing_cpu.h>
+
+/*
+ * Boundary memories of process_action(). The hardware has them for 1024
+ * macroblocks, here they are as wide as the picture.
+ */
+struct computing_state {
+	uint8_t (*mem_top_y)[16];
+	uint8_t (*mem_top_u)[8];
+	uint8_t (*mem_top_v)[8];
+	DError *top_derr;
+};
+
+static struct computing_state *state_alloc(int mb_w)
+{
+	/* VP8IteratorSaveBoundary_snap() peeks at entry 1 on narrow rows */
+	size_t w = (mb_w < 2) ? 2 : mb_w;
+	struct computing_state *st;
+	uint8_t *p;
+
+	st = calloc(1, sizeof(*st) + w * (16 + 8 + 8 + sizeof(DError)));
+	if (st == NULL)
+		return NULL;
+	p = (uint8_t *)(st + 1);
+	st->mem_top_y = (uint8_t (*)[16])p;
+	p += w * 16;
+	st->mem_top_u = (uint8_t (*)[8])p;
+	p += w * 8;
+	st->mem_top_v = (uint8_t (*)[8])p;
+	p += w * 8;
+	st->top_derr = (DError *)p;
+	return st;
+}
+
+/* Same fields, same zero fill as DATALoad() packs them into DATA_O lines */
+static void DATAStore(const DATA_O *data_o, DATA_O *dst)
+{
+	memset(dst, 0, sizeof(*dst));
+	memcpy(dst->info.y_dc_levels, data_o->info.y_dc_levels,
+	       sizeof(dst->info.y_dc_levels));
+	memcpy(dst->info.y_ac_levels, data_o->info.y_ac_levels,
+	       sizeof(dst->info.y_ac_levels));
+	memcpy(dst->info.uv_levels, data_o->info.uv_levels,
+	       sizeof(dst->info.uv_levels));
+	memcpy(dst->info.modes_i4, data_o->info.modes_i4,
+	       sizeof(dst->info.modes_i4));
+	memcpy(dst->info.derr, data_o->info.derr, sizeof(dst->info.derr));
+	dst->info.mode_i16 = data_o->info.mode_i16;
+	dst->info.mode_uv = data_o->info.mode_uv;
+	dst->info.nz = data_o->info.nz;
+	dst->mbtype = data_o->mbtype;
+	dst->is_skipped = data_o->is_skipped;
+	dst->max_edge_ = data_o->max_edge_;
+}
+
+/* Walks the macroblocks exactly like process_action() in hw/action_computing.cpp */
+int computing_cpu_run(const uint8_t *in, DATA_O *out, int mb_w, int mb_h)
+{
+	struct computing_state *st;
+	const uint8_t *yuv;
+	uint8_t Yin[16*16];
+	uint8_t UVin[8*16];
+	uint8_t Yout16[16*16];
+	uint8_t Yout4[16*16];
+	uint8_t UVout[8*16];
+	uint8_t top_y[20];
+	uint8_t top_u[8];
+	uint8_t top_v[8];
+	uint8_t left_y[16];
+	uint8_t left_u[8];
+	uint8_t left_v[8];
+	uint8_t top_left_y = 127;
+	uint8_t top_left_u = 127;
+	uint8_t top_left_v = 127;
+	uint8_t top_y_tmp1[16] = {0};
+	uint8_t top_y_tmp2[16] = {0};
+	DError left_derr = {{0}};
+	DATA_O data_o;
+	VP8SegmentInfo dqm;
+	int x, y;
+
+	if (in == NULL || out == NULL || mb_w < 1 || mb_h < 1)
+		return -1;
+
+	st = state_alloc(mb_w);
+	if (st == NULL)
+		return -1;
+
+	memset(top_y, 127, sizeof(top_y));
+	memset(top_u, 127, sizeof(top_u));
+	memset(top_v, 127, sizeof(top_v));
+	memset(left_y, 129, sizeof(left_y));
+	memset(left_u, 129, sizeof(left_u));
+	memset(left_v, 129, sizeof(left_v));
+	memset(&data_o, 0, sizeof(data_o));
+
+	/* The first 128 bytes carry the dqm */
+	SegmentInfoLoad(&dqm, in);
+
+	for (y = 0; y < mb_h; y++) {
+		for (x = 0; x < mb_w; x++) {
+			yuv = in + 128 + (y * mb_w + x) * 384;
+			memcpy(Yin, yuv, sizeof(Yin));
+			memcpy(UVin, yuv + 256, sizeof(UVin));
+
+			VP8Decimate_snap(Yin, Yout16, Yout4, &dqm, UVin, UVout,
+				&data_o.is_skipped, left_y, top_y, top_left_y,
+				&data_o.mbtype, left_u, top_u, top_left_u, left_v,
+				top_v, top_left_v, x, y, &data_o.info,
+				st->top_derr, left_derr);
+
+			VP8IteratorSaveBoundary_snap(data_o.mbtype, x, y, mb_w,
+				mb_h, Yout16, Yout4, UVout, top_y_tmp1, top_y_tmp2,
+				st->mem_top_y, st->mem_top_u, st->mem_top_v,
+				&top_left_y, &top_left_u, &top_left_v, top_y, top_u,
+				top_v, left_y, left_u, left_v);
+
+			data_o.max_edge_ = dqm.max_edge_;
+
+			DATAStore(&data_o, &out[y * mb_w + x]);
+		}
+	}
+
+	free(st);
+	return 0;
+}
+
+/*
+ * Row wavefront
+ *
+ * The kernel only looks back at the row above, at the macroblock above
+ * and the two to its right (VP8IteratorSaveBoundary_snap() fetches the
+ * top samples of x + 2 one step ahead), and left_derr starts from zero
+ * on every row. So row y can run as soon as row y - 1 is three
+ * macroblocks ahead, and the output stays bit identical.
+ *
+ * Each row works on its own boundary memories and copies the entries it
+ * is about to read from the row above. Rows finish in order, so with T
+ * threads at most T rows are in flight and T + 1 sets are enough.
+ *
+ * max_edge_ is a running maximum over the picture in raster order; each
+ * row starts it from zero and computing_cpu_run_rows() adds the rows
+ * above once all are done.
+ */
+struct computing_wave {
+	const uint8_t *in;
+	DATA_O *out;
+	int mb_w, mb_h;
+	int ring;
+	struct computing_state **st;
+	int *done;			/* macroblocks finished per row */
+	int next_row;
+};
+
+static void wave_wait(struct computing_wave *w, int y, int n)
+{
+	while (__atomic_load_n(&w->done[y], __ATOMIC_ACQUIRE) < n)
+		sched_yield();
+}
+
+static void wave_row(struct computing_wave *w, int y)
+{
+	struct computing_state *st = w->st[y % w->ring];
+	struct computing_state *up = y ? w->st[(y - 1) % w->ring] : NULL;
+	const int mb_w = w->mb_w;
+	const uint8_t *yuv;
+	uint8_t Yin[16*16];
+	uint8_t UVin[8*16];
+	uint8_t Yout16[16*16];
+	uint8_t Yout4[16*16];
+	uint8_t UVout[8*16];
+	uint8_t top_y[20];
+	uint8_t top_u[8];
+	uint8_t top_v[8];
+	uint8_t left_y[16];
+	uint8_t left_u[8];
+	uint8_t left_v[8];
+	uint8_t top_left_y = 127;
+	uint8_t top_left_u = 127;
+	uint8_t top_left_v = 127;
+	uint8_t top_y_tmp1[16] = {0};
+	uint8_t top_y_tmp2[16] = {0};
+	DError left_derr = {{0}};
+	DATA_O data_o;
+	VP8SegmentInfo dqm;
+	int x;
+
+	memset(top_y, 127, sizeof(top_y));
+	memset(top_u, 127, sizeof(top_u));
+	memset(top_v, 127, sizeof(top_v));
+	memset(left_y, 129, sizeof(left_y));
+	memset(left_u, 129, sizeof(left_u));
+	memset(left_v, 129, sizeof(left_v));
+	memset(&data_o, 0, sizeof(data_o));
+	SegmentInfoLoad(&dqm, w->in);
+
+	/* What the last macroblock of row y - 1 leaves for this row */
+	if (up != NULL) {
+		wave_wait(w, y - 1, 2);
+		top_left_y = top_left_u = top_left_v = 129;
+		memcpy(top_y_tmp2, up->mem_top_y[0], 16);
+		memcpy(top_y_tmp1, up->mem_top_y[1], 16);
+		memcpy(top_y, top_y_tmp2, 16);
+		memcpy(top_y + 16, top_y_tmp1, 4);
+		memcpy(top_u, up->mem_top_u[0], 8);
+		memcpy(top_v, up->mem_top_v[0], 8);
+	}
+
+	for (x = 0; x < mb_w; x++) {
+		if (up != NULL) {
+			wave_wait(w, y - 1, (x + 3 < mb_w) ? x + 3 : mb_w);
+			memcpy(st->top_derr[x], up->top_derr[x], sizeof(DError));
+			if (x + 2 < mb_w)
+				memcpy(st->mem_top_y[x + 2], up->mem_top_y[x + 2], 16);
+			if (x + 1 < mb_w) {
+				memcpy(st->mem_top_u[x + 1], up->mem_top_u[x + 1], 8);
+				memcpy(st->mem_top_v[x + 1], up->mem_top_v[x + 1], 8);
+			}
+		}
+
+		yuv = w->in + 128 + (y * mb_w + x) * 384;
+		memcpy(Yin, yuv, sizeof(Yin));
+		memcpy(UVin, yuv + 256, sizeof(UVin));
+
+		VP8Decimate_snap(Yin, Yout16, Yout4, &dqm, UVin, UVout,
+			&data_o.is_skipped, left_y, top_y, top_left_y,
+			&data_o.mbtype, left_u, top_u, top_left_u, left_v,
+			top_v, top_left_v, x, y, &data_o.info,
+			st->top_derr, left_derr);
+
+		VP8IteratorSaveBoundary_snap(data_o.mbtype, x, y, mb_w,
+			w->mb_h, Yout16, Yout4, UVout, top_y_tmp1, top_y_tmp2,
+			st->mem_top_y, st->mem_top_u, st->mem_top_v,
+			&top_left_y, &top_left_u, &top_left_v, top_y, top_u,
+			top_v, left_y, left_u, left_v);
+
+		data_o.max_edge_ = dqm.max_edge_;
+
+		DATAStore(&data_o, &w->out[y * mb_w + x]);
+		__atomic_store_n(&w->done[y], x + 1, __ATOMIC_RELEASE);
+	}
+}
+
+static void *wave_thread(void *arg)
+{
+	struct computing_wave *w = arg;
+	int y;
+
+	while ((y = __atomic_fetch_add(&w->next_row, 1,
+				       __ATOMIC_RELAXED)) < w->mb_h)
+		wave_row(w, y);
+	return NULL;
+}
+
+int computing_cpu_run_rows(const uint8_t *in, DATA_O *out, int mb_w,
+			   int mb_h, int threads)
+{
+	struct computing_wave w;
+	pthread_t *tid = NULL;
+	int started = 0;
+	int i, x, y, rc = -1;
+
+	if (threads > mb_h)
+		threads = mb_h;
+	if (threads <= 1 || mb_w < 2)
+		return computing_cpu_run(in, out, mb_w, mb_h);
+	if (in == NULL || out == NULL)
+		return -1;
+
+	memset(&w, 0, sizeof(w));
+	w.in = in;
+	w.out = out;
+	w.mb_w = mb_w;
+	w.mb_h = mb_h;
+	w.ring = threads + 1;
+	w.st = calloc(w.ring, sizeof(*w.st));
+	w.done = calloc(mb_h, sizeof(*w.done));
+	tid = calloc(threads - 1, sizeof(*tid));
+	if (w.st == NULL || w.done == NULL || tid == NULL)
+		goto out;
+	for (i = 0; i < w.ring; i++) {
+		w.st[i] = state_alloc(mb_w);
+		if (w.st[i] == NULL)
+			goto out;
+	}
+
+	/* The caller is one of the threads */
+	for (i = 0; i < threads - 1; i++) {
+		if (pthread_create(&tid[i], NULL, wave_thread, &w) != 0)
+			break;
+		started++;
+	}
+	wave_thread(&w);
+	for (i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+
+	for (y = 1; y < mb_h; y++) {
+		const int carry = out[y * mb_w - 1].max_edge_;
+
+		for (x = 0; x < mb_w; x++) {
+			DATA_O *o = &out[y * mb_w + x];
+
+			if (o->max_edge_ < carry)
+				o->max_edge_ = carry;
+		}
+	}
+	rc = 0;
+
+ out:
+	if (w.st != NULL)
+		for (i = 0; i < w.ring; i++)
+			free(w.st[i]);
+	free(w.st);
+	free(w.done);
+	free(tid);
+	return rc;
+}
@@ -0,0 +1,411 @@
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Unix socket front end of the encoder, see computing_daemon.h. One
+ * thread per connection; the pictures of all connections meet in the
+ * encoder pipeline behind computing_encode_image().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <computing_encode.h>
+#include <computing_daemon.h>
+
+#define DAEMON_MAX_CLIENTS	256
+#define DAEMON_MAX_INPUT	(256U << 20)
+#define DAEMON_MAX_PATH		4096
+#define DAEMON_BUCKETS		32	/* log2 of usec */
+
+static volatile sig_atomic_t stopping = 0;
+static pthread_mutex_t daemon_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t daemon_cond = PTHREAD_COND_INITIALIZER;
+static int client_fd[DAEMON_MAX_CLIENTS];
+static int clients = 0;
+static unsigned long tmp_no = 0;	/* suffix of the temporary outputs */
+
+/* Latency of the encode requests, under daemon_lock */
+static struct {
+	unsigned long count;
+	unsigned long failed;
+	unsigned long bucket[DAEMON_BUCKETS];
+	unsigned long long sum;
+	unsigned long max;
+} stats;
+
+static void daemon_stop(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void stats_add(unsigned long usec, int ok)
+{
+	int b = usec ? 63 - __builtin_clzl(usec) : 0;
+
+	if (b >= DAEMON_BUCKETS)
+		b = DAEMON_BUCKETS - 1;
+	pthread_mutex_lock(&daemon_lock);
+	stats.count++;
+	if (!ok)
+		stats.failed++;
+	stats.bucket[b]++;
+	stats.sum += usec;
+	if (usec > stats.max)
+		stats.max = usec;
+	pthread_mutex_unlock(&daemon_lock);
+}
+
+/* Upper bound of the bucket holding the p-th percentile */
+static unsigned long stats_percentile(int p)
+{
+	unsigned long want = (stats.count * p + 99) / 100, seen = 0;
+	int b;
+
+	for (b = 0; b < DAEMON_BUCKETS; b++) {
+		seen += stats.bucket[b];
+		if (seen >= want && seen > 0)
+			return 2UL << b;
+	}
+	return 0;
+}
+
+static int stats_text(char *buf, size_t size)
+{
+	int n;
+
+	pthread_mutex_lock(&daemon_lock);
+	n = snprintf(buf, size,
+		     "requests %lu failed %lu clients %d\n"
+		     "latency mean %llu max %lu usec\n"
+		     "latency p50 <%lu p90 <%lu p99 <%lu usec\n",
+		     stats.count, stats.failed, clients,
+		     stats.count ? stats.sum / stats.count : 0ULL, stats.max,
+		     stats_percentile(50), stats_percentile(90),
+		     stats_percentile(99));
+	pthread_mutex_unlock(&daemon_lock);
+	return (n < 0 || (size_t)n >= size) ? (int)size - 1 : n;
+}
+
+/* Encodes one picture; the WebP file goes to out_path or to *webp */
+static int serve_encode(const struct computing_request *req,
+			const uint8_t *in, const char *out_path,
+			uint8_t **webp, size_t *webp_len)
+{
+	const uint8_t *data = in;
+	size_t data_len = req->in_len;
+	void *map = MAP_FAILED;
+	struct stat st;
+	char tmp[DAEMON_MAX_PATH + 32];
+	int fd = -1, rc = 0;
+
+	*webp = NULL;
+	*webp_len = 0;
+	if (!(req->quality >= 0.f && req->quality <= 100.f))
+		return -EINVAL;
+	if (req->op == COMPUTING_OP_ENCODE_PATH) {
+		fd = open((const char *)in, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return -errno;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			close(fd);
+			return -EINVAL;
+		}
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED)
+			return -errno;
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		data = map;
+		data_len = st.st_size;
+	}
+
+	*webp_len = computing_encode_image(data, data_len, req->quality, webp);
+	if (map != MAP_FAILED)
+		munmap(map, data_len);
+	if (*webp_len == 0)
+		return -EIO;
+	if (out_path == NULL)
+		return 0;
+
+	/*
+	 * Written to a new file next to out_path and renamed over it, so a
+	 * failed request leaves the old output alone and no symbolic link
+	 * is followed. The mode is left to the umask.
+	 */
+	if (snprintf(tmp, sizeof(tmp), "%s.%lu.tmp", out_path,
+		     __atomic_fetch_add(&tmp_no, 1, __ATOMIC_RELAXED)) >=
+	    (int)sizeof(tmp)) {
+		rc = -ENAMETOOLONG;
+		goto out;
+	}
+	fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+		  0666);
+	if (fd < 0) {
+		rc = -errno;
+		goto out;
+	}
+	if (write_full(fd, *webp, *webp_len) != 0)
+		rc = -EIO;
+	if (close(fd) != 0 && rc == 0)
+		rc = -errno;
+	if (rc == 0 && rename(tmp, out_path) != 0)
+		rc = -errno;
+	if (rc != 0)
+		unlink(tmp);
+ out:
+	computing_encode_free(*webp);
+	*webp = NULL;
+	*webp_len = 0;
+	return rc;
+}
+
+/* Drops a connection from client_fd[] and closes it */
+static void client_remove(int fd)
+{
+	int i;
+
+	pthread_mutex_lock(&daemon_lock);
+	for (i = 0; i < clients; i++) {
+		if (client_fd[i] == fd) {
+			client_fd[i] = client_fd[--clients];
+			break;
+		}
+	}
+	pthread_cond_broadcast(&daemon_cond);
+	pthread_mutex_unlock(&daemon_lock);
+	close(fd);
+}
+
+static void *client_main(void *arg)
+{
+	int fd = (int)(long)arg;
+	struct computing_request req;
+	struct computing_reply reply;
+	char text[512];
+
+	while (read_full(fd, &req, sizeof(req)) == 0) {
+		struct timeval start, end;
+		const uint8_t *data = NULL;
+		uint8_t *buf = NULL, *webp = NULL;
+		size_t webp_len = 0;
+		int keep = 1;
+
+		gettimeofday(&start, NULL);
+		memset(&reply, 0, sizeof(reply));
+		reply.magic = COMPUTING_DAEMON_MAGIC;
+
+		if (req.magic != COMPUTING_DAEMON_MAGIC ||
+		    req.in_len > DAEMON_MAX_INPUT ||
+		    req.out_len > DAEMON_MAX_PATH ||
+		    (req.op == COMPUTING_OP_ENCODE_PATH &&
+		     req.in_len > DAEMON_MAX_PATH)) {
+			/* The stream cannot be trusted any more */
+			reply.status = -EINVAL;
+			keep = 0;
+		} else {
+			buf = malloc(req.in_len + req.out_len + 2);
+			if (buf == NULL ||
+			    read_full(fd, buf, req.in_len) != 0 ||
+			    read_full(fd, buf + req.in_len + 1,
+				      req.out_len) != 0) {
+				free(buf);
+				break;
+			}
+			buf[req.in_len] = 0;
+			buf[req.in_len + 1 + req.out_len] = 0;
+		}
+
+		if (keep) {
+			const char *out_path = req.out_len ?
+				(const char *)buf + req.in_len + 1 : NULL;
+
+			switch (req.op) {
+			case COMPUTING_OP_ENCODE:
+			case COMPUTING_OP_ENCODE_PATH:
+				reply.status = serve_encode(&req, buf, out_path,
+							    &webp, &webp_len);
+				data = webp;
+				reply.len = webp_len;
+				break;
+			case COMPUTING_OP_STATS:
+				reply.len = stats_text(text, sizeof(text));
+				data = (const uint8_t *)text;
+				break;
+			default:
+				reply.status = -EINVAL;
+				break;
+			}
+		}
+
+		gettimeofday(&end, NULL);
+		reply.usec = (end.tv_sec - start.tv_sec) * 1000000UL +
+			     end.tv_usec - start.tv_usec;
+		if (keep && req.op != COMPUTING_OP_STATS)
+			stats_add(reply.usec, reply.status == 0);
+
+		if (write_full(fd, &reply, sizeof(reply)) != 0 ||
+		    (reply.len && write_full(fd, data, reply.len) != 0))
+			keep = 0;
+		computing_encode_free(webp);
+		free(buf);
+		if (!keep)
+			break;
+	}
+
+	client_remove(fd);
+	return NULL;
+}
+
+int computing_daemon_run(const char *path, int verbose)
+{
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	pthread_attr_t attr;
+	char text[512];
+	mode_t mask;
+	int fd, rc, i;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "err: socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		fprintf(stderr, "err: socket: %s\n", strerror(errno));
+		return -1;
+	}
+	unlink(path);
+	/*
+	 * Requests name files the daemon reads and writes with its rights,
+	 * so only its own user may connect: the socket is created 0600.
+	 */
+	mask = umask(0077);
+	rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (rc != 0 || listen(fd, 64) != 0) {
+		fprintf(stderr, "err: %s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = daemon_stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	/* A client gone away shows up as a failed write */
+	signal(SIGPIPE, SIG_IGN);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (verbose)
+		fprintf(stderr, "listening on %s\n", path);
+
+	/* The signal may land on any thread, so poll for it */
+	while (!stopping) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		pthread_t tid;
+		int c;
+
+		if (poll(&pfd, 1, 200) <= 0)
+			continue;
+		c = accept(fd, NULL, NULL);
+		if (c < 0)
+			continue;
+
+		pthread_mutex_lock(&daemon_lock);
+		if (clients == DAEMON_MAX_CLIENTS) {
+			pthread_mutex_unlock(&daemon_lock);
+			close(c);
+			continue;
+		}
+		client_fd[clients++] = c;
+		pthread_mutex_unlock(&daemon_lock);
+
+		/* Other threads may have left the list meanwhile */
+		if (pthread_create(&tid, &attr, client_main,
+				   (void *)(long)c) != 0)
+			client_remove(c);
+	}
+	pthread_attr_destroy(&attr);
+	close(fd);
+	unlink(path);
+
+	/* Let the requests in progress finish, then drop the connections */
+	pthread_mutex_lock(&daemon_lock);
+	for (i = 0; i < clients; i++)
+		shutdown(client_fd[i], SHUT_RD);
+	while (clients > 0)
+		pthread_cond_wait(&daemon_cond, &daemon_lock);
+	pthread_mutex_unlock(&daemon_lock);
+
+	if (verbose) {
+		stats_text(text, sizeof(text));
+		fprintf(stderr, "%s", text);
+	}
+	return 0;
+}
@@ -0,0 +1,157 @@
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Index of the pack files, see computing_pack.h.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE			/* qsort_r() */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include <computing_pack.h>
+
+static int entry_cmp(const void *a, const void *b, void *names)
+{
+	const struct computing_pack_entry *ea = a, *eb = b;
+
+	return strcmp((const char *)names + ea->name,
+		      (const char *)names + eb->name);
+}
+
+int computing_pack_write_index(const char *path,
+			       struct computing_pack_entry *entry,
+			       uint32_t count, const char *names,
+			       uint32_t names_len)
+{
+	struct computing_pack_header h;
+	struct iovec iov[3];
+	char tmp[4096];
+	size_t left;
+	int fd, i = 0;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	qsort_r(entry, count, sizeof(*entry), entry_cmp, (void *)names);
+
+	h.magic = COMPUTING_PACK_MAGIC;
+	h.version = COMPUTING_PACK_VERSION;
+	h.count = count;
+	h.names = names_len;
+	iov[0].iov_base = &h;
+	iov[0].iov_len = sizeof(h);
+	iov[1].iov_base = entry;
+	iov[1].iov_len = (size_t)count * sizeof(*entry);
+	iov[2].iov_base = (void *)names;
+	iov[2].iov_len = names_len;
+	left = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+	while (left > 0) {
+		ssize_t w = writev(fd, iov + i, 3 - i);
+
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w <= 0)
+			goto fail;
+		left -= w;
+		while (i < 3 && (size_t)w >= iov[i].iov_len) {
+			w -= iov[i].iov_len;
+			i++;
+		}
+		if (i < 3) {
+			iov[i].iov_base = (uint8_t *)iov[i].iov_base + w;
+			iov[i].iov_len -= w;
+		}
+	}
+	if (fsync(fd) != 0)
+		goto fail;
+	close(fd);
+	return rename(tmp, path);
+
+ fail:
+	close(fd);
+	unlink(tmp);
+	return -1;
+}
+
+int computing_pack_check(const void *index, size_t size)
+{
+	const struct computing_pack_header *h = index;
+	const struct computing_pack_entry *e;
+	const char *names;
+	uint32_t i;
+
+	if (size < sizeof(*h) || h->magic != COMPUTING_PACK_MAGIC ||
+	    h->version != COMPUTING_PACK_VERSION)
+		return -1;
+	if ((size - sizeof(*h)) / sizeof(*e) < h->count ||
+	    size - sizeof(*h) - (size_t)h->count * sizeof(*e) != h->names)
+		return -1;
+	e = (const struct computing_pack_entry *)(h + 1);
+	names = (const char *)(e + h->count);
+	if (h->names > 0 && names[h->names - 1] != '\0')
+		return -1;
+	for (i = 0; i < h->count; i++)
+		if (e[i].name >= h->names)
+			return -1;
+	return 0;
+}
+
+const char *computing_pack_name(const void *index,
+				const struct computing_pack_entry *e)
+{
+	const struct computing_pack_header *h = index;
+
+	return (const char *)((const struct computing_pack_entry *)(h + 1) +
+			      h->count) + e->name;
+}
+
+const struct computing_pack_entry *computing_pack_find(const void *index,
+							const char *name)
+{
+	const struct computing_pack_header *h = index;
+	const struct computing_pack_entry *e =
+		(const struct computing_pack_entry *)(h + 1);
+	uint32_t lo = 0, hi = h->count;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int c = strcmp(computing_pack_name(index, &e[mid]), name);
+
+		if (c == 0)
+			return &e[mid];
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Size class pool for the mem_in / mem_out buffers of the action.
+ *
+ * Every buffer is its own anonymous mapping. The first page holds the
+ * bookkeeping, the caller gets the memory behind it, so the buffer is
+ * page aligned as the action requires.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <computing_pool.h>
+
+#define POOL_PAGE	4096UL
+#define POOL_HUGE	(2UL << 20)
+#define POOL_STEPS	4		/* size classes per power of two */
+#define POOL_CLASSES	(64 * POOL_STEPS)
+
+struct pool_buf {
+	struct pool_buf *next;
+	size_t map_size;		/* whole mapping, header page included */
+	int cls;
+};
+
+static struct pool_buf *free_list[POOL_CLASSES];
+static size_t cached_bytes = 0;
+static size_t max_cached = 256UL << 20;
+static int use_hugepage = 0;
+static unsigned long hits = 0, misses = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Class of a mapping of 'size' bytes and the size of that class */
+static int pool_class(size_t size, size_t *cls_size)
+{
+	int b = 63 - __builtin_clzl(size);
+	size_t step_size, step;
+
+	if (b < 14)			/* smallest class is 16 KiB */
+		b = 14;
+	step_size = (1UL << b) / POOL_STEPS;
+	step = (size > (1UL << b)) ?
+		(size - (1UL << b) + step_size - 1) / step_size : 0;
+	if (step == POOL_STEPS) {
+		b++;
+		step = 0;
+	}
+	*cls_size = (1UL << b) + step * ((1UL << b) / POOL_STEPS);
+	return b * POOL_STEPS + step;
+}
+
+static struct pool_buf *pool_map(size_t map_size, int cls)
+{
+	struct pool_buf *p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	if (use_hugepage && map_size >= POOL_HUGE) {
+		size_t huge_size = (map_size + POOL_HUGE - 1) & ~(POOL_HUGE - 1);
+
+		p = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+			 MAP_POPULATE, -1, 0);
+		if (p != MAP_FAILED)
+			map_size = huge_size;
+	}
+#endif
+	if (p == MAP_FAILED) {
+		p = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+		if (p == MAP_FAILED)
+			return NULL;
+#ifdef MADV_HUGEPAGE
+		if (use_hugepage && map_size >= POOL_HUGE)
+			madvise(p, map_size, MADV_HUGEPAGE);
+#endif
+	}
+	p->next = NULL;
+	p->map_size = map_size;
+	p->cls = cls;
+	return p;
+}
+
+void computing_pool_init(size_t max, int hugepage)
+{
+	pthread_mutex_lock(&pool_lock);
+	max_cached = max;
+	use_hugepage = hugepage;
+	pthread_mutex_unlock(&pool_lock);
+}
+
+void *computing_pool_alloc(size_t size)
+{
+	struct pool_buf *p;
+	size_t cls_size;
+	int cls;
+
+	if (size == 0)
+		size = 1;
+	cls = pool_class(size + POOL_PAGE, &cls_size);
+
+	pthread_mutex_lock(&pool_lock);
+	p = free_list[cls];
+	if (p != NULL) {
+		free_list[cls] = p->next;
+		cached_bytes -= p->map_size;
+		hits++;
+	} else {
+		misses++;
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	if (p == NULL)
+		p = pool_map(cls_size, cls);
+	if (p == NULL)
+		return NULL;
+	return (uint8_t *)p + POOL_PAGE;
+}
+
+void computing_pool_free(void *buf)
+{
+	struct pool_buf *p;
+
+	if (buf == NULL)
+		return;
+	p = (struct pool_buf *)((uint8_t *)buf - POOL_PAGE);
+
+	pthread_mutex_lock(&pool_lock);
+	if (cached_bytes + p->map_size <= max_cached) {
+		p->next = free_list[p->cls];
+		free_list[p->cls] = p;
+		cached_bytes += p->map_size;
+		p = NULL;
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	if (p != NULL)
+		munmap(p, p->map_size);
+}
+
+void computing_pool_fini(int verbose)
+{
+	int cls;
+
+	pthread_mutex_lock(&pool_lock);
+	for (cls = 0; cls < POOL_CLASSES; cls++) {
+		while (free_list[cls] != NULL) {
+			struct pool_buf *p = free_list[cls];
+
+			free_list[cls] = p->next;
+			munmap(p, p->map_size);
+		}
+	}
+	cached_bytes = 0;
+	if (verbose)
+		fprintf(stderr, "buffer pool: %lu reused, %lu mapped\n",
+			hits, misses);
+	pthread_mutex_unlock(&pool_lock);
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Bounded MPMC ring with a sequence number per cell (D. Vyukov). Two
+ * counting semaphores sit in front of the ring: 'slots' makes producers
+ * wait while it is full, 'items' makes consumers wait while it is empty,
+ * so the ring operations never fail for lack of space or data.
+ */
+
+#include <stdlib.h>
+#include <sched.h>
+#include <semaphore.h>
+
+#include <computing_queue.h>
+
+struct queue_cell {
+	unsigned long seq;
+	void *item;
+};
+
+struct computing_queue {
+	struct queue_cell *cell;
+	unsigned long mask;
+	unsigned int depth;
+	int closed;
+	sem_t items;
+	sem_t slots;
+	unsigned long head __attribute__((aligned(64)));	/* next push */
+	unsigned long tail __attribute__((aligned(64)));	/* next pop */
+};
+
+struct computing_queue *computing_queue_alloc(unsigned int depth)
+{
+	struct computing_queue *q;
+	unsigned long size = 1, i;
+
+	if (depth == 0)
+		depth = 1;
+	while (size < depth)
+		size <<= 1;
+
+	if (posix_memalign((void **)&q, 64, sizeof(*q)) != 0)
+		return NULL;
+	q->cell = calloc(size, sizeof(*q->cell));
+	if (q->cell == NULL) {
+		free(q);
+		return NULL;
+	}
+	for (i = 0; i < size; i++)
+		q->cell[i].seq = i;
+	q->mask = size - 1;
+	q->depth = depth;
+	q->closed = 0;
+	q->head = 0;
+	q->tail = 0;
+	sem_init(&q->items, 0, 0);
+	sem_init(&q->slots, 0, depth);
+	return q;
+}
+
+void computing_queue_free(struct computing_queue *q)
+{
+	if (q == NULL)
+		return;
+	sem_destroy(&q->items);
+	sem_destroy(&q->slots);
+	free(q->cell);
+	free(q);
+}
+
+/* Returns 0 if the cell at 'head' is still taken by a slow consumer */
+static int queue_put(struct computing_queue *q, void *item)
+{
+	unsigned long pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	struct queue_cell *c;
+
+	for (;;) {
+		long diff;
+
+		c = &q->cell[pos & q->mask];
+		diff = (long)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return 0;
+		} else {
+			pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+		}
+	}
+	c->item = item;
+	__atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/* Returns NULL if the cell at 'tail' is not published yet */
+static void *queue_get(struct computing_queue *q)
+{
+	unsigned long pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	struct queue_cell *c;
+	void *item;
+
+	for (;;) {
+		long diff;
+
+		c = &q->cell[pos & q->mask];
+		diff = (long)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) -
+			      (pos + 1));
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return NULL;
+		} else {
+			pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+		}
+	}
+	item = c->item;
+	__atomic_store_n(&c->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+	return item;
+}
+
+int computing_queue_push(struct computing_queue *q, void *item)
+{
+	if (__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE))
+		return -1;
+	while (sem_wait(&q->slots) != 0)
+		;
+	/* a slot is ours, the cell is only late if a consumer is mid-pop */
+	while (!queue_put(q, item))
+		sched_yield();
+	sem_post(&q->items);
+	return 0;
+}
+
+static void *queue_take(struct computing_queue *q)
+{
+	void *item;
+
+	for (;;) {
+		item = queue_get(q);
+		if (item != NULL)
+			break;
+		/* the post left by computing_queue_close() */
+		if (__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE) &&
+		    __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) ==
+		    __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) {
+			sem_post(&q->items);
+			return NULL;
+		}
+		sched_yield();
+	}
+	sem_post(&q->slots);
+	return item;
+}
+
+void *computing_queue_pop(struct computing_queue *q)
+{
+	while (sem_wait(&q->items) != 0)
+		;
+	return queue_take(q);
+}
+
+void *computing_queue_trypop(struct computing_queue *q)
+{
+	if (sem_trywait(&q->items) != 0)
+		return NULL;
+	return queue_take(q);
+}
+
+void computing_queue_close(struct computing_queue *q)
+{
+	__atomic_store_n(&q->closed, 1, __ATOMIC_RELEASE);
+	sem_post(&q->items);
+}
@@ -0,0 +1,145 @@
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Area average rescaler, see computing_rescale.h. Both axes use the same
+ * table: destination sample i covers [i * S, (i + 1) * S) in units where
+ * source sample j covers [j * D, (j + 1) * D), the weight of j is the
+ * length of the overlap. The rows are scaled horizontally into 8.8 fixed
+ * point first, then every destination row sums the rows it covers.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <computing_rescale.h>
+
+#define RESCALE_BITS	14
+#define RESCALE_ONE	(1 << RESCALE_BITS)
+
+struct rescale_axis {
+	int *start;		/* first source sample of each destination */
+	int *count;
+	uint32_t *w;		/* max_count weights per destination */
+	int max_count;
+};
+
+static void axis_free(struct rescale_axis *a)
+{
+	free(a->start);
+	free(a->count);
+	free(a->w);
+}
+
+static int axis_init(struct rescale_axis *a, int src, int dst)
+{
+	int i;
+
+	a->max_count = src / dst + 2;
+	a->start = malloc(dst * sizeof(*a->start));
+	a->count = malloc(dst * sizeof(*a->count));
+	a->w = calloc((size_t)dst * a->max_count, sizeof(*a->w));
+	if (a->start == NULL || a->count == NULL || a->w == NULL) {
+		axis_free(a);
+		return -1;
+	}
+	for (i = 0; i < dst; i++) {
+		const long lo = (long)i * src, hi = (long)(i + 1) * src;
+		const int j0 = lo / dst, j1 = (hi - 1) / dst;
+		uint32_t *w = a->w + (size_t)i * a->max_count;
+		uint32_t sum = 0;
+		int j, big = 0;
+
+		a->start[i] = j0;
+		a->count[i] = j1 - j0 + 1;
+		for (j = j0; j <= j1; j++) {
+			const long b = (long)j * dst, e = b + dst;
+			const long ov = (e < hi ? e : hi) - (b > lo ? b : lo);
+
+			w[j - j0] = (ov * RESCALE_ONE + src / 2) / src;
+			sum += w[j - j0];
+			if (w[j - j0] > w[big])
+				big = j - j0;
+		}
+		/* the rounding error goes to the largest weight */
+		w[big] += RESCALE_ONE - sum;
+	}
+	return 0;
+}
+
+int computing_rescale_plane(const uint8_t *src, int src_w, int src_h,
+			    int src_stride, uint8_t *dst, int dst_w,
+			    int dst_h, int dst_stride)
+{
+	struct rescale_axis ax, ay;
+	uint16_t *tmp;
+	uint32_t *acc;
+	int x, y, k;
+
+	if (axis_init(&ax, src_w, dst_w) != 0)
+		return -1;
+	if (axis_init(&ay, src_h, dst_h) != 0) {
+		axis_free(&ax);
+		return -1;
+	}
+	tmp = malloc((size_t)src_h * dst_w * sizeof(*tmp));
+	acc = malloc((size_t)dst_w * sizeof(*acc));
+	if (tmp == NULL || acc == NULL) {
+		free(tmp);
+		free(acc);
+		axis_free(&ax);
+		axis_free(&ay);
+		return -1;
+	}
+
+	for (y = 0; y < src_h; y++) {
+		const uint8_t *s = src + (size_t)y * src_stride;
+		uint16_t *t = tmp + (size_t)y * dst_w;
+
+		for (x = 0; x < dst_w; x++) {
+			const uint8_t *p = s + ax.start[x];
+			const uint32_t *w = ax.w + (size_t)x * ax.max_count;
+			uint32_t sum = 0;
+
+			for (k = 0; k < ax.count[x]; k++)
+				sum += w[k] * p[k];
+			t[x] = (sum + (1 << (RESCALE_BITS - 9))) >>
+				(RESCALE_BITS - 8);
+		}
+	}
+
+	for (y = 0; y < dst_h; y++) {
+		const uint16_t *t = tmp + (size_t)ay.start[y] * dst_w;
+		const uint32_t *w = ay.w + (size_t)y * ay.max_count;
+		uint8_t *d = dst + (size_t)y * dst_stride;
+
+		memset(acc, 0, dst_w * sizeof(*acc));
+		for (k = 0; k < ay.count[y]; k++, t += dst_w)
+			for (x = 0; x < dst_w; x++)
+				acc[x] += w[k] * t[x];
+		for (x = 0; x < dst_w; x++)
+			d[x] = (acc[x] + (1 << (RESCALE_BITS + 7))) >>
+				(RESCALE_BITS + 8);
+	}
+
+	free(tmp);
+	free(acc);
+	axis_free(&ax);
+	axis_free(&ay);
+	return 0;
+}
@@ -0,0 +1,232 @@
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Extracts pictures from the pack files of hls_computing -pack.
+ *
+ *   computing_unpack <prefix-NNNN.idx>                  list the pack
+ *   computing_unpack <prefix-NNNN.idx> <name>           picture to stdout
+ *   computing_unpack <prefix-NNNN.idx> -o <dir> [name...]
+ *                    pictures (all without a name) under <dir>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <computing_pack.h>
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s <pack.idx> [-o <dir>] [name...]\n"
+		"  without a name, lists the pack or extracts all of it\n"
+		"  with -o; one name without -o goes to stdout\n", prog);
+}
+
+static const void *map_file(const char *path, size_t *size)
+{
+	struct stat st;
+	void *map;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	*size = st.st_size;
+	return map;
+}
+
+static int write_full(int fd, const uint8_t *p, size_t len)
+{
+	while (len > 0) {
+		ssize_t w = write(fd, p, len);
+
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w <= 0)
+			return -1;
+		p += w;
+		len -= w;
+	}
+	return 0;
+}
+
+/* No absolute names and no .. components, the pack stays under dir */
+static int safe_name(const char *name)
+{
+	const char *c = name;
+
+	if (name[0] == '/' || name[0] == '\0')
+		return 0;
+	while (c != NULL) {
+		if (c[0] == '.' && c[1] == '.' && (c[2] == '/' || c[2] == '\0'))
+			return 0;
+		c = strchr(c, '/');
+		if (c != NULL)
+			c++;
+	}
+	return 1;
+}
+
+/* dir/name, with the directories of name */
+static int extract(const uint8_t *pack, const char *dir, const char *name,
+		   const struct computing_pack_entry *e)
+{
+	char path[4096];
+	char *sep;
+	int fd;
+
+	if (!safe_name(name)) {
+		fprintf(stderr, "err: refusing to extract '%s'\n", name);
+		return -1;
+	}
+	if (snprintf(path, sizeof(path), "%s/%s", dir, name) >=
+	    (int)sizeof(path)) {
+		fprintf(stderr, "err: path too long '%s/%s'\n", dir, name);
+		return -1;
+	}
+	for (sep = strchr(path + strlen(dir) + 1, '/'); sep != NULL;
+	     sep = strchr(sep + 1, '/')) {
+		*sep = '\0';
+		mkdir(path, 0755);
+		*sep = '/';
+	}
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || write_full(fd, pack + e->offset, e->length) != 0) {
+		fprintf(stderr, "err: cannot write '%s': %s\n", path,
+			strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct computing_pack_header *h;
+	const struct computing_pack_entry *e;
+	const void *index;
+	const uint8_t *pack;
+	const char *dir = NULL;
+	char pack_path[4096];
+	size_t index_size, pack_size = 0, len;
+	int i, first, rc = 0;
+	uint32_t n;
+
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+	index = map_file(argv[1], &index_size);
+	if (index == NULL || computing_pack_check(index, index_size) != 0) {
+		fprintf(stderr, "err: '%s' is not a pack index\n", argv[1]);
+		return 1;
+	}
+	h = index;
+	e = (const struct computing_pack_entry *)(h + 1);
+
+	first = 2;
+	if (argc > 3 && !strcmp(argv[2], "-o")) {
+		dir = argv[3];
+		first = 4;
+	}
+	if (dir == NULL && argc == 2) {
+		for (n = 0; n < h->count; n++)
+			printf("%s %llu %u\n", computing_pack_name(index, &e[n]),
+			       (unsigned long long)e[n].offset, e[n].length);
+		return 0;
+	}
+	if (dir == NULL && argc != 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	len = strlen(argv[1]);
+	if (len < 4 || strcmp(argv[1] + len - 4, ".idx") != 0 ||
+	    snprintf(pack_path, sizeof(pack_path), "%.*s.pack",
+		     (int)(len - 4), argv[1]) >= (int)sizeof(pack_path)) {
+		fprintf(stderr, "err: '%s' does not end in .idx\n", argv[1]);
+		return 1;
+	}
+	pack = map_file(pack_path, &pack_size);
+	if (pack == NULL && h->count > 0) {
+		fprintf(stderr, "err: cannot map '%s'\n", pack_path);
+		return 1;
+	}
+	for (n = 0; n < h->count; n++) {
+		if (e[n].offset > pack_size ||
+		    e[n].length > pack_size - e[n].offset) {
+			fprintf(stderr, "err: '%s' is shorter than its index\n",
+				pack_path);
+			return 1;
+		}
+	}
+
+	if (dir == NULL) {
+		const struct computing_pack_entry *f =
+			computing_pack_find(index, argv[2]);
+
+		if (f == NULL) {
+			fprintf(stderr, "err: '%s' is not in the pack\n",
+				argv[2]);
+			return 1;
+		}
+		return write_full(STDOUT_FILENO, pack + f->offset,
+				  f->length) ? 1 : 0;
+	}
+
+	if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "err: cannot create '%s': %s\n", dir,
+			strerror(errno));
+		return 1;
+	}
+	if (first == argc) {
+		for (n = 0; n < h->count; n++)
+			if (extract(pack, dir, computing_pack_name(index,
+					&e[n]), &e[n]) != 0)
+				rc = 1;
+		return rc;
+	}
+	for (i = first; i < argc; i++) {
+		const struct computing_pack_entry *f =
+			computing_pack_find(index, argv[i]);
+
+		if (f == NULL) {
+			fprintf(stderr, "err: '%s' is not in the pack\n",
+				argv[i]);
+			rc = 1;
+		} else if (extract(pack, dir, argv[i], f) != 0) {
+			rc = 1;
+		}
+	}
+	return rc;
+}
@@ -0,0 +1,475 @@
+
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Writer thread of the output stage, see computing_writer.h.
+ *
+ * Copies (the RIFF and chunk headers) go to a small arena inside the
+ * output and neighbouring copies share one iovec; everything else is a
+ * reference. With fsync batching the writer starts the writeback of each
+ * file as soon as it is written and keeps the descriptor open, so the
+ * fsync of the batch mostly finds the data already on its way.
+ *
+ * In pack mode the outputs are appended to the current pack file instead
+ * and their path is only a name in its index (computing_pack.h).
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE			/* sync_file_range() */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include <computing_cache.h>
+#include <computing_pack.h>
+#include <computing_queue.h>
+#include <computing_writer.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX			1024
+#endif
+#define OUT_ARENA		256	/* bytes of copies kept inline */
+#define OUT_CHUNKS		16	/* chunks before the first resize */
+#define WRITER_MAX_BATCH	1024
+
+struct out_ref {
+	void *data;
+	void (*release)(void *);
+};
+
+struct computing_out {
+	char *path;
+	struct iovec *iov;
+	struct out_ref *ref;
+	int n, refs, max;
+	int cache;		/* store under cache_key once complete */
+	uint64_t cache_key;
+	size_t arena_len;
+	uint8_t arena[OUT_ARENA];
+};
+
+static struct computing_queue *writer_queue = NULL;
+static pthread_t writer_thread;
+static int writer_sync = 0;
+static int batch_fd[WRITER_MAX_BATCH];
+static char *batch_path[WRITER_MAX_BATCH];
+static int batch = 0;
+
+/* Pack mode, prefix is NULL without it */
+static char *pack_prefix = NULL;
+static uint64_t pack_rotate = 0;
+static unsigned int pack_no = 0;
+static int pack_fd = -1;
+static uint64_t pack_off = 0;
+static int pack_unsynced = 0;
+static struct computing_pack_entry *pack_entry = NULL;
+static uint32_t pack_count = 0, pack_max = 0;
+static char *pack_names = NULL;
+static uint32_t pack_names_len = 0, pack_names_max = 0;
+
+/* Counters of the writer thread, read after it is joined */
+static unsigned long files = 0, failed = 0, syncs = 0;
+static unsigned long long bytes = 0;
+
+struct computing_out *computing_out_new(const char *path)
+{
+	struct computing_out *o = calloc(1, sizeof(*o));
+
+	if (o == NULL)
+		return NULL;
+	o->path = strdup(path);
+	if (o->path == NULL) {
+		free(o);
+		return NULL;
+	}
+	return o;
+}
+
+static int out_grow(struct computing_out *o)
+{
+	int max = o->max ? 2 * o->max : OUT_CHUNKS;
+	struct iovec *iov;
+	struct out_ref *ref;
+
+	iov = realloc(o->iov, max * sizeof(*iov));
+	if (iov == NULL)
+		return -1;
+	o->iov = iov;
+	ref = realloc(o->ref, max * sizeof(*ref));
+	if (ref == NULL)
+		return -1;
+	o->ref = ref;
+	o->max = max;
+	return 0;
+}
+
+int computing_out_take(struct computing_out *o, void *data, size_t len,
+		       void (*release)(void *))
+{
+	if ((o->n == o->max || o->refs == o->max) && out_grow(o) != 0) {
+		if (release != NULL)
+			release(data);
+		return -1;
+	}
+	if (release != NULL) {
+		o->ref[o->refs].data = data;
+		o->ref[o->refs].release = release;
+		o->refs++;
+	}
+	if (len > 0) {
+		o->iov[o->n].iov_base = data;
+		o->iov[o->n].iov_len = len;
+		o->n++;
+	}
+	return 0;
+}
+
+int computing_out_copy(struct computing_out *o, const void *data, size_t len)
+{
+	uint8_t *dst;
+
+	if (len == 0)
+		return 0;
+	if (o->arena_len + len > OUT_ARENA) {
+		dst = malloc(len);
+		if (dst == NULL)
+			return -1;
+		memcpy(dst, data, len);
+		return computing_out_take(o, dst, len, free);
+	}
+
+	dst = o->arena + o->arena_len;
+	memcpy(dst, data, len);
+	o->arena_len += len;
+	if (o->n > 0 && (uint8_t *)o->iov[o->n - 1].iov_base +
+	    o->iov[o->n - 1].iov_len == dst) {
+		o->iov[o->n - 1].iov_len += len;
+		return 0;
+	}
+	return computing_out_take(o, dst, len, NULL);
+}
+
+static void out_free(struct computing_out *o)
+{
+	int i;
+
+	for (i = 0; i < o->refs; i++)
+		o->ref[i].release(o->ref[i].data);
+	free(o->iov);
+	free(o->ref);
+	free(o->path);
+	free(o);
+}
+
+void computing_out_cache(struct computing_out *o, uint64_t key)
+{
+	o->cache = 1;
+	o->cache_key = key;
+}
+
+void computing_out_discard(struct computing_out *o)
+{
+	if (o != NULL)
+		out_free(o);
+}
+
+void computing_out_submit(struct computing_out *o)
+{
+	if (computing_queue_push(writer_queue, o) != 0)
+		out_free(o);
+}
+
+/* writev() of the whole list, across IOV_MAX and short writes */
+static int write_iov(int fd, struct iovec *iov, int n)
+{
+	while (n > 0) {
+		ssize_t w = writev(fd, iov, n > IOV_MAX ? IOV_MAX : n);
+
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w <= 0)
+			return -1;
+		bytes += w;
+		while (n > 0 && (size_t)w >= iov->iov_len) {
+			w -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+	return 0;
+}
+
+static void batch_flush(void)
+{
+	int i;
+
+	if (pack_unsynced > 0) {
+		if (fdatasync(pack_fd) != 0) {
+			fprintf(stderr, "err: fsync pack %u failed: %s\n",
+				pack_no, strerror(errno));
+			failed++;
+		}
+		pack_unsynced = 0;
+		syncs++;
+	}
+
+	for (i = 0; i < batch; i++) {
+		if (fsync(batch_fd[i]) != 0) {
+			fprintf(stderr, "err: fsync '%s' failed: %s\n",
+				batch_path[i], strerror(errno));
+			failed++;
+		}
+		close(batch_fd[i]);
+		free(batch_path[i]);
+	}
+	if (batch > 0)
+		syncs++;
+	batch = 0;
+}
+
+static void pack_close(void)
+{
+	char path[4096];
+
+	if (pack_fd < 0)
+		return;
+	snprintf(path, sizeof(path), "%s-%04u.idx", pack_prefix, pack_no);
+	if (fdatasync(pack_fd) != 0 ||
+	    computing_pack_write_index(path, pack_entry, pack_count,
+				       pack_names, pack_names_len) != 0) {
+		fprintf(stderr, "err: cannot write pack index '%s': %s\n",
+			path, strerror(errno));
+		failed += pack_count;
+	}
+	close(pack_fd);
+	pack_fd = -1;
+	pack_off = 0;
+	pack_unsynced = 0;
+	pack_count = 0;
+	pack_names_len = 0;
+	pack_no++;
+}
+
+static int pack_open(void)
+{
+	char path[4096];
+
+	snprintf(path, sizeof(path), "%s-%04u.pack", pack_prefix, pack_no);
+	pack_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (pack_fd < 0) {
+		fprintf(stderr, "err: cannot open pack file '%s': %s\n",
+			path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Index entry of the output just written at pack_off */
+static int pack_add(const char *name, size_t len)
+{
+	size_t name_len = strlen(name) + 1;
+
+	if (pack_count == pack_max) {
+		uint32_t max = pack_max ? 2 * pack_max : 1024;
+		struct computing_pack_entry *e;
+
+		e = realloc(pack_entry, max * sizeof(*e));
+		if (e == NULL)
+			return -1;
+		pack_entry = e;
+		pack_max = max;
+	}
+	while (pack_names_len + name_len > pack_names_max) {
+		uint32_t max = pack_names_max ? 2 * pack_names_max : 65536;
+		char *n = realloc(pack_names, max);
+
+		if (n == NULL)
+			return -1;
+		pack_names = n;
+		pack_names_max = max;
+	}
+	pack_entry[pack_count].offset = pack_off;
+	pack_entry[pack_count].length = len;
+	pack_entry[pack_count].name = pack_names_len;
+	pack_count++;
+	memcpy(pack_names + pack_names_len, name, name_len);
+	pack_names_len += name_len;
+	return 0;
+}
+
+static void pack_write(struct computing_out *o)
+{
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < o->n; i++)
+		len += o->iov[i].iov_len;
+	if (pack_fd >= 0 && pack_rotate > 0 && pack_off > 0 &&
+	    pack_off + len > pack_rotate)
+		pack_close();
+	if (pack_fd < 0 && pack_open() != 0) {
+		failed++;
+		return;
+	}
+	if (len > UINT32_MAX || write_iov(pack_fd, o->iov, o->n) != 0) {
+		fprintf(stderr, "err: cannot write '%s' to pack %u: %s\n",
+			o->path, pack_no, strerror(errno));
+		failed++;
+		/* a partial write must not shift the next entries */
+		if (ftruncate(pack_fd, pack_off) != 0 ||
+		    lseek(pack_fd, pack_off, SEEK_SET) < 0)
+			pack_close();
+		return;
+	}
+	if (pack_add(o->path, len) != 0) {
+		fprintf(stderr, "err: pack index of '%s' out of memory\n",
+			o->path);
+		failed++;
+	} else {
+		files++;
+	}
+	pack_off += len;
+	if (writer_sync > 0 && ++pack_unsynced >= writer_sync)
+		batch_flush();
+}
+
+static void out_write(struct computing_out *o)
+{
+	int fd = open(o->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0) {
+		fprintf(stderr, "err: cannot open output file '%s': %s\n",
+			o->path, strerror(errno));
+		failed++;
+		return;
+	}
+	if (write_iov(fd, o->iov, o->n) != 0) {
+		fprintf(stderr, "err: cannot write output file '%s': %s\n",
+			o->path, strerror(errno));
+		failed++;
+		close(fd);
+		unlink(o->path);
+		return;
+	}
+	files++;
+	if (writer_sync == 0) {
+		close(fd);
+		return;
+	}
+#ifdef SYNC_FILE_RANGE_WRITE
+	sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+	batch_fd[batch] = fd;
+	batch_path[batch] = o->path;
+	o->path = NULL;
+	if (++batch == writer_sync)
+		batch_flush();
+}
+
+static void *writer_main(void *arg)
+{
+	struct computing_out *o;
+
+	for (;;) {
+		o = computing_queue_trypop(writer_queue);
+		if (o == NULL) {
+			/* idle: do not keep a partial batch waiting */
+			batch_flush();
+			o = computing_queue_pop(writer_queue);
+			if (o == NULL)
+				break;
+		}
+		/* before the write, which consumes the iovecs */
+		if (o->cache && computing_cache_put(o->cache_key, o->iov,
+						    o->n) != 0)
+			fprintf(stderr, "err: cannot cache '%s'\n", o->path);
+		if (pack_prefix != NULL)
+			pack_write(o);
+		else
+			out_write(o);
+		out_free(o);
+	}
+	batch_flush();
+	if (pack_prefix != NULL)
+		pack_close();
+	return arg;
+}
+
+int computing_writer_pack(const char *prefix, size_t rotate)
+{
+	free(pack_prefix);
+	pack_prefix = NULL;
+	if (prefix == NULL)
+		return 0;
+	pack_prefix = strdup(prefix);
+	if (pack_prefix == NULL)
+		return -1;
+	pack_rotate = rotate;
+	pack_no = 0;
+	return 0;
+}
+
+int computing_writer_start(unsigned int depth, int sync_batch)
+{
+	writer_queue = computing_queue_alloc(depth);
+	if (writer_queue == NULL)
+		return -1;
+	writer_sync = sync_batch < 0 ? 0 :
+		sync_batch > WRITER_MAX_BATCH ? WRITER_MAX_BATCH : sync_batch;
+	files = failed = syncs = 0;
+	bytes = 0;
+	if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+		computing_queue_free(writer_queue);
+		writer_queue = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+int computing_writer_stop(int verbose)
+{
+	if (writer_queue == NULL)
+		return 0;
+	computing_queue_close(writer_queue);
+	pthread_join(writer_thread, NULL);
+	computing_queue_free(writer_queue);
+	writer_queue = NULL;
+	free(pack_entry);
+	free(pack_names);
+	pack_entry = NULL;
+	pack_names = NULL;
+	pack_max = pack_names_max = 0;
+	if (verbose && pack_prefix != NULL)
+		fprintf(stderr, "writer: %u pack files\n", pack_no);
+	if (verbose)
+		fprintf(stderr, "writer: %lu files, %llu bytes, %lu syncs, "
+			"%lu failed\n", files, bytes, syncs, failed);
+	return (int)failed;
+}
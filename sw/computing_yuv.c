@@ -0,0 +1,700 @@
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * RGB to YUV 4:2:0 row kernels, plain and sharp. The x86 versions are built with the
+ * target attribute, so no -m flags are needed, and only run once
+ * computing_yuv_init() has seen the instructions in cpuid. Everything is
+ * integer arithmetic on 32-bit lanes, or on 16-bit lanes where the values
+ * cannot leave them, hence bit exact with the C code.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <computing_yuv.h>
+
+#define YUV_FIX		16
+#define YUV_HALF	(1 << (YUV_FIX - 1))
+#define Y_OFFSET	(YUV_HALF + (16 << YUV_FIX))
+#define UV_OFFSET	((YUV_HALF << 2) + (128 << (YUV_FIX + 2)))
+
+/* Gamma tables of the 2x2 averages, as in libwebp's picture_csp_enc.c */
+#define GAMMA		0.80
+#define GAMMA_FIX	12
+#define GAMMA_SCALE	((1 << GAMMA_FIX) - 1)
+#define GAMMA_TAB_FIX	7
+#define GAMMA_TAB_SIZE	(1 << (GAMMA_FIX - GAMMA_TAB_FIX))
+#define GAMMA_FRAC	((1 << GAMMA_TAB_FIX) << 2)	/* sum of 4 values */
+
+/* W of the sharp conversion, 8 bits plus 2 of precision */
+#define SHARP_MAX_W	((256 << 2) - 1)
+
+static int32_t gamma_to_linear[256];
+static int32_t linear_to_gamma[GAMMA_TAB_SIZE + 1];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void init_tables(void)
+{
+	const double scale = (double)(1 << GAMMA_TAB_FIX) / GAMMA_SCALE;
+	const double norm = 1. / 255.;
+	int v;
+
+	for (v = 0; v <= 255; v++)
+		gamma_to_linear[v] =
+			(uint16_t)(pow(norm * v, GAMMA) * GAMMA_SCALE + .5);
+	for (v = 0; v <= GAMMA_TAB_SIZE; v++)
+		linear_to_gamma[v] =
+			(int)(255. * pow(scale * v, 1. / GAMMA) + .5);
+}
+
+static inline int to_y(int r, int g, int b)
+{
+	return (16839 * r + 33059 * g + 6420 * b + Y_OFFSET) >> YUV_FIX;
+}
+
+static inline int clip_uv(int uv)
+{
+	uv = (uv + UV_OFFSET) >> (YUV_FIX + 2);
+	return ((uv & ~0xff) == 0) ? uv : (uv < 0) ? 0 : 255;
+}
+
+/* 'v' is a sum of 4 linear values */
+static inline int to_gamma(int v)
+{
+	const int pos = v >> (GAMMA_TAB_FIX + 2);
+	const int x = v & (GAMMA_FRAC - 1);
+	const int y = linear_to_gamma[pos + 1] * x +
+		      linear_to_gamma[pos] * (GAMMA_FRAC - x);
+
+	return (y + (1 << (GAMMA_TAB_FIX - 1))) >> GAMMA_TAB_FIX;
+}
+
+static void rgb_to_y_c(const uint8_t *rgb, int step, int swap_rb,
+		       uint8_t *y, int width)
+{
+	const int r = swap_rb ? 2 : 0;
+	int i;
+
+	for (i = 0; i < width; i++, rgb += step)
+		y[i] = to_y(rgb[r], rgb[1], rgb[2 - r]);
+}
+
+static void rgb_accumulate_c(const uint8_t *rgb, int step, int swap_rb,
+			     int stride, uint16_t *dst, int width)
+{
+	const int32_t *lin = gamma_to_linear;
+	int i, c;
+
+	pthread_once(&tables_once, init_tables);
+	for (i = 0; i < (width >> 1); i++, rgb += 2 * step, dst += 4) {
+		for (c = 0; c < 3; c++) {
+			const uint8_t *p = rgb + (swap_rb ? 2 - c : c);
+
+			dst[c] = to_gamma(lin[p[0]] + lin[p[step]] +
+					  lin[p[stride]] +
+					  lin[p[stride + step]]);
+		}
+	}
+	if (width & 1) {
+		for (c = 0; c < 3; c++) {
+			const uint8_t *p = rgb + (swap_rb ? 2 - c : c);
+
+			dst[c] = to_gamma((lin[p[0]] + lin[p[stride]]) << 1);
+		}
+	}
+}
+
+static void rgb_to_uv_c(const uint16_t *rgb, uint8_t *u, uint8_t *v,
+			int width)
+{
+	int i;
+
+	for (i = 0; i < width; i++, rgb += 4) {
+		const int r = rgb[0], g = rgb[1], b = rgb[2];
+
+		u[i] = clip_uv(-9719 * r - 19081 * g + 28800 * b);
+		v[i] = clip_uv(28800 * r - 24116 * g - 4684 * b);
+	}
+}
+
+static inline int clip_w(int w)
+{
+	return ((w & ~SHARP_MAX_W) == 0) ? w : (w < 0) ? 0 : SHARP_MAX_W;
+}
+
+static uint64_t sharp_update_y_c(const uint16_t *ref, const uint16_t *src,
+				 uint16_t *dst, int len)
+{
+	uint64_t diff = 0;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		const int d = ref[i] - src[i];
+
+		dst[i] = clip_w(dst[i] + d);
+		diff += (d < 0) ? -d : d;
+	}
+	return diff;
+}
+
+static void sharp_update_rgb_c(const int16_t *ref, const int16_t *src,
+			       int16_t *dst, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		dst[i] += ref[i] - src[i];
+}
+
+static void sharp_filter_row_c(const int16_t *a, const int16_t *b, int len,
+			       const uint16_t *best_y, uint16_t *out)
+{
+	int i;
+
+	for (i = 0; i < len; i++, a++, b++) {
+		const int v0 = (a[0] * 9 + a[1] * 3 + b[0] * 3 + b[1] + 8) >> 4;
+		const int v1 = (a[1] * 9 + a[0] * 3 + b[1] * 3 + b[0] + 8) >> 4;
+
+		out[2 * i + 0] = clip_w(best_y[2 * i + 0] + v0);
+		out[2 * i + 1] = clip_w(best_y[2 * i + 1] + v1);
+	}
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define YUV_X86
+#include <immintrin.h>
+
+#define SSE41	__attribute__((target("sse4.1")))
+#define AVX2	__attribute__((target("avx2")))
+
+/* pshufb mask taking byte 'c' of 4 pixels of 'step' bytes into the low
+   byte of 4 32-bit lanes */
+static void channel_mask(uint8_t m[16], int step, int c)
+{
+	int k;
+
+	memset(m, 0x80, 16);
+	for (k = 0; k < 4; k++)
+		m[4 * k] = k * step + c;
+}
+
+SSE41 static inline __m128i luma_sse41(__m128i px, const __m128i m[3])
+{
+	const __m128i r = _mm_shuffle_epi8(px, m[0]);
+	const __m128i g = _mm_shuffle_epi8(px, m[1]);
+	const __m128i b = _mm_shuffle_epi8(px, m[2]);
+	__m128i y = _mm_mullo_epi32(r, _mm_set1_epi32(16839));
+
+	y = _mm_add_epi32(y, _mm_mullo_epi32(g, _mm_set1_epi32(33059)));
+	y = _mm_add_epi32(y, _mm_mullo_epi32(b, _mm_set1_epi32(6420)));
+	y = _mm_add_epi32(y, _mm_set1_epi32(Y_OFFSET));
+	return _mm_srli_epi32(y, YUV_FIX);
+}
+
+SSE41 static void rgb_to_y_sse41(const uint8_t *rgb, int step, int swap_rb,
+				 uint8_t *y, int width)
+{
+	uint8_t mask[3][16];
+	__m128i m[3];
+	int i, c;
+
+	for (c = 0; c < 3; c++) {
+		channel_mask(mask[c], step, swap_rb ? 2 - c : c);
+		m[c] = _mm_loadu_si128((const __m128i *)mask[c]);
+	}
+	/* 8 pixels, the loads must stay inside the row */
+	for (i = 0; (i + 4) * step + 16 <= width * step; i += 8) {
+		const __m128i a = luma_sse41(
+			_mm_loadu_si128((const __m128i *)(rgb + i * step)), m);
+		const __m128i b = luma_sse41(
+			_mm_loadu_si128((const __m128i *)(rgb + (i + 4) * step)),
+			m);
+		const __m128i y16 = _mm_packus_epi32(a, b);
+
+		_mm_storel_epi64((__m128i *)(y + i), _mm_packus_epi16(y16, y16));
+	}
+	rgb_to_y_c(rgb + i * step, step, swap_rb, y + i, width - i);
+}
+
+/* U or V of 4 entries from madd results of 2 entries each */
+SSE41 static inline __m128i chroma_sse41(__m128i a, __m128i b)
+{
+	const __m128i uv = _mm_hadd_epi32(a, b);
+
+	return _mm_srai_epi32(_mm_add_epi32(uv, _mm_set1_epi32(UV_OFFSET)),
+			      YUV_FIX + 2);
+}
+
+SSE41 static void rgb_to_uv_sse41(const uint16_t *rgb, uint8_t *u,
+				  uint8_t *v, int width)
+{
+	const __m128i ku = _mm_setr_epi16(-9719, -19081, 28800, 0,
+					  -9719, -19081, 28800, 0);
+	const __m128i kv = _mm_setr_epi16(28800, -24116, -4684, 0,
+					  28800, -24116, -4684, 0);
+	int i;
+
+	for (i = 0; i + 8 <= width; i += 8, rgb += 32) {
+		const __m128i e0 = _mm_loadu_si128((const __m128i *)rgb + 0);
+		const __m128i e1 = _mm_loadu_si128((const __m128i *)rgb + 1);
+		const __m128i e2 = _mm_loadu_si128((const __m128i *)rgb + 2);
+		const __m128i e3 = _mm_loadu_si128((const __m128i *)rgb + 3);
+		const __m128i u0 = chroma_sse41(_mm_madd_epi16(e0, ku),
+						_mm_madd_epi16(e1, ku));
+		const __m128i u1 = chroma_sse41(_mm_madd_epi16(e2, ku),
+						_mm_madd_epi16(e3, ku));
+		const __m128i v0 = chroma_sse41(_mm_madd_epi16(e0, kv),
+						_mm_madd_epi16(e1, kv));
+		const __m128i v1 = chroma_sse41(_mm_madd_epi16(e2, kv),
+						_mm_madd_epi16(e3, kv));
+		const __m128i uv = _mm_packus_epi16(_mm_packs_epi32(u0, u1),
+						    _mm_packs_epi32(v0, v1));
+
+		_mm_storel_epi64((__m128i *)(u + i), uv);
+		_mm_storel_epi64((__m128i *)(v + i), _mm_srli_si128(uv, 8));
+	}
+	rgb_to_uv_c(rgb, u + i, v + i, width - i);
+}
+
+/* 8 at a time in 16 bits: W and its differences stay within +-2047 */
+SSE41 static uint64_t sharp_update_y_sse41(const uint16_t *ref,
+					   const uint16_t *src,
+					   uint16_t *dst, int len)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi16(SHARP_MAX_W);
+	const __m128i one = _mm_set1_epi16(1);
+	__m128i sum = zero;
+	uint64_t s[2];
+	int i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		const __m128i d = _mm_sub_epi16(
+			_mm_loadu_si128((const __m128i *)(ref + i)),
+			_mm_loadu_si128((const __m128i *)(src + i)));
+		const __m128i y = _mm_add_epi16(
+			_mm_loadu_si128((const __m128i *)(dst + i)), d);
+		const __m128i a = _mm_madd_epi16(_mm_abs_epi16(d), one);
+
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 _mm_min_epi16(_mm_max_epi16(y, zero), max));
+		sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(a, zero));
+		sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(a, zero));
+	}
+	_mm_storeu_si128((__m128i *)s, sum);
+	return s[0] + s[1] +
+	       sharp_update_y_c(ref + i, src + i, dst + i, len - i);
+}
+
+SSE41 static void sharp_update_rgb_sse41(const int16_t *ref,
+					 const int16_t *src, int16_t *dst,
+					 int len)
+{
+	int i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		const __m128i d = _mm_sub_epi16(
+			_mm_loadu_si128((const __m128i *)(ref + i)),
+			_mm_loadu_si128((const __m128i *)(src + i)));
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi16(
+			_mm_loadu_si128((const __m128i *)(dst + i)), d));
+	}
+	sharp_update_rgb_c(ref + i, src + i, dst + i, len - i);
+}
+
+/* (9 * a0 + 3 * a1 + 3 * b0 + b1 + 8) >> 4 on 32-bit lanes */
+SSE41 static inline __m128i taps_sse41(__m128i a0, __m128i a1, __m128i b0,
+				       __m128i b1)
+{
+	const __m128i m = _mm_add_epi32(a1, b0);
+	__m128i v = _mm_add_epi32(_mm_slli_epi32(a0, 3), a0);
+
+	v = _mm_add_epi32(v, _mm_add_epi32(_mm_slli_epi32(m, 1), m));
+	v = _mm_add_epi32(v, _mm_add_epi32(b1, _mm_set1_epi32(8)));
+	return _mm_srai_epi32(v, 4);
+}
+
+SSE41 static inline __m128i load4_sse41(const int16_t *p)
+{
+	return _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)p));
+}
+
+SSE41 static void sharp_filter_row_sse41(const int16_t *a, const int16_t *b,
+					 int len, const uint16_t *best_y,
+					 uint16_t *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi32(SHARP_MAX_W);
+	int i;
+
+	/* 4 entries, 8 samples */
+	for (i = 0; i + 4 <= len; i += 4) {
+		const __m128i a0 = load4_sse41(a + i);
+		const __m128i a1 = load4_sse41(a + i + 1);
+		const __m128i b0 = load4_sse41(b + i);
+		const __m128i b1 = load4_sse41(b + i + 1);
+		const __m128i v0 = taps_sse41(a0, a1, b0, b1);
+		const __m128i v1 = taps_sse41(a1, a0, b1, b0);
+		const __m128i y = _mm_loadu_si128((const __m128i *)
+						  (best_y + 2 * i));
+		__m128i lo = _mm_add_epi32(_mm_cvtepu16_epi32(y),
+					   _mm_unpacklo_epi32(v0, v1));
+		__m128i hi = _mm_add_epi32(_mm_cvtepu16_epi32(
+						   _mm_srli_si128(y, 8)),
+					   _mm_unpackhi_epi32(v0, v1));
+
+		lo = _mm_min_epi32(_mm_max_epi32(lo, zero), max);
+		hi = _mm_min_epi32(_mm_max_epi32(hi, zero), max);
+		_mm_storeu_si128((__m128i *)(out + 2 * i),
+				 _mm_packus_epi32(lo, hi));
+	}
+	sharp_filter_row_c(a + i, b + i, len - i, best_y + 2 * i,
+			   out + 2 * i);
+}
+
+/* Lanes 0-3 from 'lo', 4-7 from 'hi' */
+AVX2 static inline __m256i load_pair(const uint8_t *lo, const uint8_t *hi)
+{
+	return _mm256_inserti128_si256(
+		_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)lo)),
+		_mm_loadu_si128((const __m128i *)hi), 1);
+}
+
+AVX2 static inline __m256i luma_avx2(__m256i px, const __m256i m[3])
+{
+	const __m256i r = _mm256_shuffle_epi8(px, m[0]);
+	const __m256i g = _mm256_shuffle_epi8(px, m[1]);
+	const __m256i b = _mm256_shuffle_epi8(px, m[2]);
+	__m256i y = _mm256_mullo_epi32(r, _mm256_set1_epi32(16839));
+
+	y = _mm256_add_epi32(y, _mm256_mullo_epi32(g, _mm256_set1_epi32(33059)));
+	y = _mm256_add_epi32(y, _mm256_mullo_epi32(b, _mm256_set1_epi32(6420)));
+	y = _mm256_add_epi32(y, _mm256_set1_epi32(Y_OFFSET));
+	return _mm256_srli_epi32(y, YUV_FIX);
+}
+
+AVX2 static void channel_masks_avx2(__m256i m[3], int step, int swap_rb)
+{
+	uint8_t mask[16];
+	int c;
+
+	for (c = 0; c < 3; c++) {
+		channel_mask(mask, step, swap_rb ? 2 - c : c);
+		m[c] = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i *)mask));
+	}
+}
+
+AVX2 static void rgb_to_y_avx2(const uint8_t *rgb, int step, int swap_rb,
+			       uint8_t *y, int width)
+{
+	__m256i m[3];
+	int i;
+
+	channel_masks_avx2(m, step, swap_rb);
+	/* 16 pixels, the loads must stay inside the row */
+	for (i = 0; (i + 12) * step + 16 <= width * step; i += 16) {
+		const uint8_t *p = rgb + i * step;
+		const __m256i a = luma_avx2(load_pair(p, p + 4 * step), m);
+		const __m256i b = luma_avx2(load_pair(p + 8 * step,
+						      p + 12 * step), m);
+		/* packus works per 128-bit lane: 0-3 8-11 | 4-7 12-15 */
+		const __m256i y16 = _mm256_permute4x64_epi64(
+			_mm256_packus_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+
+		_mm_storeu_si128((__m128i *)(y + i),
+				 _mm_packus_epi16(_mm256_castsi256_si128(y16),
+					_mm256_extracti128_si256(y16, 1)));
+	}
+	rgb_to_y_c(rgb + i * step, step, swap_rb, y + i, width - i);
+}
+
+/* Linear sums of the 8 horizontal pairs of channel 'm' of 16 pixels */
+AVX2 static inline __m256i pairs_avx2(const uint8_t *p, int step, __m256i m)
+{
+	const __m256i a = _mm256_shuffle_epi8(load_pair(p, p + 4 * step), m);
+	const __m256i b = _mm256_shuffle_epi8(load_pair(p + 8 * step,
+							 p + 12 * step), m);
+
+	/* hadd works per 128-bit lane: blocks 0 1 4 5 | 2 3 6 7 */
+	return _mm256_hadd_epi32(
+		_mm256_i32gather_epi32((const int *)gamma_to_linear, a, 4),
+		_mm256_i32gather_epi32((const int *)gamma_to_linear, b, 4));
+}
+
+AVX2 static inline __m256i gamma_avx2(const uint8_t *p, int step, int stride,
+				      __m256i m)
+{
+	const __m256i frac = _mm256_set1_epi32(GAMMA_FRAC - 1);
+	__m256i v = _mm256_add_epi32(pairs_avx2(p, step, m),
+				     pairs_avx2(p + stride, step, m));
+	__m256i pos, x, v0, v1;
+
+	v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+	pos = _mm256_srli_epi32(v, GAMMA_TAB_FIX + 2);
+	x = _mm256_and_si256(v, frac);
+	v0 = _mm256_i32gather_epi32((const int *)linear_to_gamma, pos, 4);
+	v1 = _mm256_i32gather_epi32((const int *)linear_to_gamma + 1, pos, 4);
+	v = _mm256_add_epi32(_mm256_mullo_epi32(v1, x),
+		_mm256_mullo_epi32(v0, _mm256_sub_epi32(
+			_mm256_set1_epi32(GAMMA_FRAC), x)));
+	v = _mm256_add_epi32(v, _mm256_set1_epi32(1 << (GAMMA_TAB_FIX - 1)));
+	return _mm256_srli_epi32(v, GAMMA_TAB_FIX);
+}
+
+AVX2 static void rgb_accumulate_avx2(const uint8_t *rgb, int step,
+				     int swap_rb, int stride, uint16_t *dst,
+				     int width)
+{
+	__m256i m[3];
+	int i;
+
+	channel_masks_avx2(m, step, swap_rb);
+	/* 8 blocks of 2x2 pixels */
+	for (i = 0; (2 * i + 12) * step + 16 <= width * step; i += 8) {
+		const uint8_t *p = rgb + 2 * i * step;
+		const __m256i r = gamma_avx2(p, step, stride, m[0]);
+		const __m256i g = gamma_avx2(p, step, stride, m[1]);
+		const __m256i b = gamma_avx2(p, step, stride, m[2]);
+		const __m256i rg = _mm256_or_si256(r, _mm256_slli_epi32(g, 16));
+		/* entries 0 1 4 5 and 2 3 6 7 */
+		const __m256i lo = _mm256_unpacklo_epi32(rg, b);
+		const __m256i hi = _mm256_unpackhi_epi32(rg, b);
+
+		_mm256_storeu_si256((__m256i *)(dst + 4 * i),
+				    _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst + 4 * i + 16),
+				    _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	rgb_accumulate_c(rgb + 2 * i * step, step, swap_rb, stride,
+			 dst + 4 * i, width - 2 * i);
+}
+
+AVX2 static inline __m256i chroma_avx2(__m256i a, __m256i b)
+{
+	/* hadd works per 128-bit lane: entries 0 1 4 5 | 2 3 6 7 */
+	const __m256i uv = _mm256_permute4x64_epi64(_mm256_hadd_epi32(a, b),
+						    _MM_SHUFFLE(3, 1, 2, 0));
+
+	return _mm256_srai_epi32(
+		_mm256_add_epi32(uv, _mm256_set1_epi32(UV_OFFSET)),
+		YUV_FIX + 2);
+}
+
+AVX2 static void rgb_to_uv_avx2(const uint16_t *rgb, uint8_t *u, uint8_t *v,
+				int width)
+{
+	const __m256i ku = _mm256_setr_epi16(-9719, -19081, 28800, 0,
+					     -9719, -19081, 28800, 0,
+					     -9719, -19081, 28800, 0,
+					     -9719, -19081, 28800, 0);
+	const __m256i kv = _mm256_setr_epi16(28800, -24116, -4684, 0,
+					     28800, -24116, -4684, 0,
+					     28800, -24116, -4684, 0,
+					     28800, -24116, -4684, 0);
+	int i;
+
+	for (i = 0; i + 8 <= width; i += 8, rgb += 32) {
+		const __m256i e0 = _mm256_loadu_si256((const __m256i *)rgb);
+		const __m256i e1 = _mm256_loadu_si256((const __m256i *)rgb + 1);
+		const __m256i u8 = chroma_avx2(_mm256_madd_epi16(e0, ku),
+					       _mm256_madd_epi16(e1, ku));
+		const __m256i v8 = chroma_avx2(_mm256_madd_epi16(e0, kv),
+					       _mm256_madd_epi16(e1, kv));
+		const __m128i uv = _mm_packus_epi16(
+			_mm_packs_epi32(_mm256_castsi256_si128(u8),
+					_mm256_extracti128_si256(u8, 1)),
+			_mm_packs_epi32(_mm256_castsi256_si128(v8),
+					_mm256_extracti128_si256(v8, 1)));
+
+		_mm_storel_epi64((__m128i *)(u + i), uv);
+		_mm_storel_epi64((__m128i *)(v + i), _mm_srli_si128(uv, 8));
+	}
+	rgb_to_uv_c(rgb, u + i, v + i, width - i);
+}
+
+AVX2 static uint64_t sharp_update_y_avx2(const uint16_t *ref,
+					 const uint16_t *src,
+					 uint16_t *dst, int len)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi16(SHARP_MAX_W);
+	const __m256i one = _mm256_set1_epi16(1);
+	__m256i sum = zero;
+	uint64_t s[4];
+	int i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		const __m256i d = _mm256_sub_epi16(
+			_mm256_loadu_si256((const __m256i *)(ref + i)),
+			_mm256_loadu_si256((const __m256i *)(src + i)));
+		const __m256i y = _mm256_add_epi16(
+			_mm256_loadu_si256((const __m256i *)(dst + i)), d);
+		const __m256i a = _mm256_madd_epi16(_mm256_abs_epi16(d), one);
+
+		_mm256_storeu_si256((__m256i *)(dst + i),
+			_mm256_min_epi16(_mm256_max_epi16(y, zero), max));
+		sum = _mm256_add_epi64(sum, _mm256_unpacklo_epi32(a, zero));
+		sum = _mm256_add_epi64(sum, _mm256_unpackhi_epi32(a, zero));
+	}
+	_mm256_storeu_si256((__m256i *)s, sum);
+	return s[0] + s[1] + s[2] + s[3] +
+	       sharp_update_y_c(ref + i, src + i, dst + i, len - i);
+}
+
+AVX2 static void sharp_update_rgb_avx2(const int16_t *ref,
+				       const int16_t *src, int16_t *dst,
+				       int len)
+{
+	int i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		const __m256i d = _mm256_sub_epi16(
+			_mm256_loadu_si256((const __m256i *)(ref + i)),
+			_mm256_loadu_si256((const __m256i *)(src + i)));
+
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_add_epi16(
+			_mm256_loadu_si256((const __m256i *)(dst + i)), d));
+	}
+	sharp_update_rgb_c(ref + i, src + i, dst + i, len - i);
+}
+
+AVX2 static inline __m256i taps_avx2(__m256i a0, __m256i a1, __m256i b0,
+				     __m256i b1)
+{
+	const __m256i m = _mm256_add_epi32(a1, b0);
+	__m256i v = _mm256_add_epi32(_mm256_slli_epi32(a0, 3), a0);
+
+	v = _mm256_add_epi32(v, _mm256_add_epi32(_mm256_slli_epi32(m, 1), m));
+	v = _mm256_add_epi32(v, _mm256_add_epi32(b1, _mm256_set1_epi32(8)));
+	return _mm256_srai_epi32(v, 4);
+}
+
+AVX2 static inline __m256i load8_avx2(const int16_t *p)
+{
+	return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)p));
+}
+
+AVX2 static inline __m256i clip_w_avx2(__m256i w)
+{
+	return _mm256_min_epi32(_mm256_max_epi32(w, _mm256_setzero_si256()),
+				_mm256_set1_epi32(SHARP_MAX_W));
+}
+
+AVX2 static void sharp_filter_row_avx2(const int16_t *a, const int16_t *b,
+				       int len, const uint16_t *best_y,
+				       uint16_t *out)
+{
+	int i;
+
+	/* 8 entries, 16 samples */
+	for (i = 0; i + 8 <= len; i += 8) {
+		const __m256i a0 = load8_avx2(a + i);
+		const __m256i a1 = load8_avx2(a + i + 1);
+		const __m256i b0 = load8_avx2(b + i);
+		const __m256i b1 = load8_avx2(b + i + 1);
+		const __m256i v0 = taps_avx2(a0, a1, b0, b1);
+		const __m256i v1 = taps_avx2(a1, a0, b1, b0);
+		/* unpack works per 128-bit lane: samples 0-3 8-11 | 4-7 12-15 */
+		const __m256i lo = _mm256_unpacklo_epi32(v0, v1);
+		const __m256i hi = _mm256_unpackhi_epi32(v0, v1);
+		const __m256i y = _mm256_loadu_si256((const __m256i *)
+						     (best_y + 2 * i));
+		const __m256i s0 = clip_w_avx2(_mm256_add_epi32(
+			_mm256_cvtepu16_epi32(_mm256_castsi256_si128(y)),
+			_mm256_permute2x128_si256(lo, hi, 0x20)));
+		const __m256i s1 = clip_w_avx2(_mm256_add_epi32(
+			_mm256_cvtepu16_epi32(_mm256_extracti128_si256(y, 1)),
+			_mm256_permute2x128_si256(lo, hi, 0x31)));
+
+		_mm256_storeu_si256((__m256i *)(out + 2 * i),
+			_mm256_permute4x64_epi64(_mm256_packus_epi32(s0, s1),
+						 _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	sharp_filter_row_c(a + i, b + i, len - i, best_y + 2 * i,
+			   out + 2 * i);
+}
+#endif	/* x86 */
+
+void (*computing_rgb_to_y)(const uint8_t *rgb, int step, int swap_rb,
+			   uint8_t *y, int width) = rgb_to_y_c;
+void (*computing_rgb_accumulate)(const uint8_t *rgb, int step, int swap_rb,
+				 int stride, uint16_t *dst,
+				 int width) = rgb_accumulate_c;
+void (*computing_rgb_to_uv)(const uint16_t *rgb, uint8_t *u, uint8_t *v,
+			    int width) = rgb_to_uv_c;
+uint64_t (*computing_sharp_update_y)(const uint16_t *ref, const uint16_t *src,
+				     uint16_t *dst, int len) = sharp_update_y_c;
+void (*computing_sharp_update_rgb)(const int16_t *ref, const int16_t *src,
+				   int16_t *dst, int len) = sharp_update_rgb_c;
+void (*computing_sharp_filter_row)(const int16_t *a, const int16_t *b,
+				   int len, const uint16_t *best_y,
+				   uint16_t *out) = sharp_filter_row_c;
+
+int computing_yuv_init(int max)
+{
+	int impl = COMPUTING_YUV_C;
+
+	pthread_once(&tables_once, init_tables);
+#ifdef YUV_X86
+	__builtin_cpu_init();
+	if (max >= COMPUTING_YUV_AVX2 && __builtin_cpu_supports("avx2"))
+		impl = COMPUTING_YUV_AVX2;
+	else if (max >= COMPUTING_YUV_SSE41 &&
+		 __builtin_cpu_supports("sse4.1"))
+		impl = COMPUTING_YUV_SSE41;
+#endif
+	computing_rgb_to_y = rgb_to_y_c;
+	computing_rgb_accumulate = rgb_accumulate_c;
+	computing_rgb_to_uv = rgb_to_uv_c;
+	computing_sharp_update_y = sharp_update_y_c;
+	computing_sharp_update_rgb = sharp_update_rgb_c;
+	computing_sharp_filter_row = sharp_filter_row_c;
+#ifdef YUV_X86
+	if (impl == COMPUTING_YUV_SSE41) {
+		/* no gather, the table lookups stay in C */
+		computing_rgb_to_y = rgb_to_y_sse41;
+		computing_rgb_to_uv = rgb_to_uv_sse41;
+		computing_sharp_update_y = sharp_update_y_sse41;
+		computing_sharp_update_rgb = sharp_update_rgb_sse41;
+		computing_sharp_filter_row = sharp_filter_row_sse41;
+	} else if (impl == COMPUTING_YUV_AVX2) {
+		computing_rgb_to_y = rgb_to_y_avx2;
+		computing_rgb_accumulate = rgb_accumulate_avx2;
+		computing_rgb_to_uv = rgb_to_uv_avx2;
+		computing_sharp_update_y = sharp_update_y_avx2;
+		computing_sharp_update_rgb = sharp_update_rgb_avx2;
+		computing_sharp_filter_row = sharp_filter_row_avx2;
+	}
+#endif
+	return impl;
+}
+
+const char *computing_yuv_name(int impl)
+{
+	switch (impl) {
+	case COMPUTING_YUV_SSE41:
+		return "sse4.1";
+	case COMPUTING_YUV_AVX2:
+		return "avx2";
+	default:
+		return "c";
+	}
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright 2017 International Business Machines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Times the RGB to YUV kernels of computing_yuv.h, plain and sharp, on
+ * every version the cpu supports and checks that each one gives the
+ * bytes of the C code.
+ *
+ *   computing_yuvbench [width height [frames]]     default 1920 1080 20
+ *
+ * Exits with 1 if a version does not match.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <computing_yuv.h>
+
+struct frame {
+	int width, height, step;
+	uint8_t *rgb;
+	uint8_t *y, *u, *v;
+	uint16_t *acc;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Converts the frame like the picture import: Y, then the 2x2 averages
+   and U/V of every pair of rows. */
+static void convert(struct frame *f, int swap_rb)
+{
+	const int stride = f->width * f->step;
+	const int uv_width = (f->width + 1) >> 1;
+	int y;
+
+	for (y = 0; y < f->height; y++)
+		computing_rgb_to_y(f->rgb + y * stride, f->step, swap_rb,
+				   f->y + y * f->width, f->width);
+	for (y = 0; y < f->height; y += 2) {
+		const int pair = (y + 1 < f->height) ? stride : 0;
+
+		computing_rgb_accumulate(f->rgb + y * stride, f->step, swap_rb,
+					 pair, f->acc, f->width);
+		computing_rgb_to_uv(f->acc, f->u + (y >> 1) * uv_width,
+				    f->v + (y >> 1) * uv_width, uv_width);
+	}
+}
+
+/* The rows of one pass of the sharp conversion */
+struct sharp {
+	int w, uv_w;
+	uint16_t *target_y, *rgb_y, *best_y, *out;
+	int16_t *target_uv, *rgb_uv, *best_uv;
+	uint64_t diff;
+};
+
+static int sharp_alloc(struct sharp *s, int width)
+{
+	int i;
+
+	s->w = (width + 1) & ~1;
+	s->uv_w = s->w >> 1;
+	s->target_y = malloc(2 * s->w * sizeof(uint16_t));
+	s->rgb_y = malloc(2 * s->w * sizeof(uint16_t));
+	s->best_y = malloc(2 * s->w * sizeof(uint16_t));
+	s->out = calloc(2 * s->w, sizeof(uint16_t));
+	s->target_uv = malloc(3 * s->uv_w * sizeof(int16_t));
+	s->rgb_uv = malloc(3 * s->uv_w * sizeof(int16_t));
+	s->best_uv = malloc(3 * s->uv_w * sizeof(int16_t));
+	if (!s->target_y || !s->rgb_y || !s->best_y || !s->out ||
+	    !s->target_uv || !s->rgb_uv || !s->best_uv)
+		return -1;
+	srand(2);
+	for (i = 0; i < 2 * s->w; i++) {
+		s->target_y[i] = rand() & 1023;
+		s->rgb_y[i] = rand() & 1023;
+		s->best_y[i] = rand() & 1023;
+	}
+	/* the chroma of photos is small, but any value must work */
+	for (i = 0; i < 3 * s->uv_w; i++) {
+		s->target_uv[i] = (int16_t)rand();
+		s->rgb_uv[i] = (int16_t)rand();
+		s->best_uv[i] = (i & 1) ? (int16_t)rand() : rand() % 2048 - 1024;
+	}
+	s->diff = 0;
+	return 0;
+}
+
+static void sharp_free(struct sharp *s)
+{
+	free(s->target_y);
+	free(s->rgb_y);
+	free(s->best_y);
+	free(s->out);
+	free(s->target_uv);
+	free(s->rgb_uv);
+	free(s->best_uv);
+}
+
+/* Like a pass over 'rows' pairs of rows, on the same buffers */
+static void sharp_pass(struct sharp *s, int rows)
+{
+	const int len = (s->w - 1) >> 1;
+	int y, c;
+
+	for (y = 0; y < rows; y++) {
+		for (c = 0; c < 3; c++) {
+			const int16_t *uv = s->best_uv + c * s->uv_w;
+
+			computing_sharp_filter_row(uv, s->rgb_uv + c * s->uv_w,
+						   len, s->best_y + 1,
+						   s->out + 1);
+			computing_sharp_filter_row(uv, s->target_uv +
+						   c * s->uv_w, len,
+						   s->best_y + s->w + 1,
+						   s->out + s->w + 1);
+		}
+		s->diff += computing_sharp_update_y(s->target_y, s->out,
+						    s->best_y, 2 * s->w);
+		computing_sharp_update_rgb(s->target_uv, s->rgb_uv,
+					   s->best_uv, 3 * s->uv_w);
+	}
+}
+
+static int sharp_same(const struct sharp *a, const struct sharp *b)
+{
+	return a->diff == b->diff &&
+	       !memcmp(a->best_y, b->best_y, 2 * a->w * sizeof(uint16_t)) &&
+	       !memcmp(a->out, b->out, 2 * a->w * sizeof(uint16_t)) &&
+	       !memcmp(a->best_uv, b->best_uv,
+		       3 * a->uv_w * sizeof(int16_t));
+}
+
+static int frame_alloc(struct frame *f, int width, int height, int step)
+{
+	const size_t uv = (size_t)((width + 1) >> 1) * ((height + 1) >> 1);
+	size_t i;
+
+	f->width = width;
+	f->height = height;
+	f->step = step;
+	f->rgb = malloc((size_t)width * height * step);
+	f->y = malloc((size_t)width * height);
+	f->u = malloc(uv);
+	f->v = malloc(uv);
+	f->acc = malloc(4 * sizeof(*f->acc) * ((width + 1) >> 1));
+	if (!f->rgb || !f->y || !f->u || !f->v || !f->acc)
+		return -1;
+	/* smooth gradients with some noise, like a photo */
+	srand(1);
+	for (i = 0; i < (size_t)width * height * step; i++)
+		f->rgb[i] = (uint8_t)(i / step % width * 255 / width +
+				      (rand() & 31));
+	return 0;
+}
+
+static void frame_free(struct frame *f)
+{
+	free(f->rgb);
+	free(f->y);
+	free(f->u);
+	free(f->v);
+	free(f->acc);
+}
+
+int main(int argc, char *argv[])
+{
+	const int width = (argc > 2) ? atoi(argv[1]) : 1920;
+	const int height = (argc > 2) ? atoi(argv[2]) : 1080;
+	const int frames = (argc > 3) ? atoi(argv[3]) : 20;
+	const size_t uv = (size_t)((width + 1) >> 1) * ((height + 1) >> 1);
+	int failed = 0, impl, step;
+
+	if (width <= 0 || height <= 0 || frames <= 0) {
+		fprintf(stderr, "Usage: %s [width height [frames]]\n", argv[0]);
+		return 2;
+	}
+	for (step = 3; step <= 4; step++) {
+		struct frame ref, f;
+		int swap_rb;
+
+		if (frame_alloc(&ref, width, height, step) != 0 ||
+		    frame_alloc(&f, width, height, step) != 0) {
+			fprintf(stderr, "out of memory\n");
+			return 2;
+		}
+		for (impl = COMPUTING_YUV_C; impl <= COMPUTING_YUV_AVX2;
+		     impl++) {
+			double t;
+			int n, ok = 1;
+
+			if (computing_yuv_init(impl) != impl)
+				continue;
+			for (swap_rb = 0; swap_rb <= 1; swap_rb++) {
+				computing_yuv_init(COMPUTING_YUV_C);
+				convert(&ref, swap_rb);
+				computing_yuv_init(impl);
+				convert(&f, swap_rb);
+				ok &= !memcmp(ref.y, f.y,
+					      (size_t)width * height) &&
+				      !memcmp(ref.u, f.u, uv) &&
+				      !memcmp(ref.v, f.v, uv);
+			}
+			t = now();
+			for (n = 0; n < frames; n++)
+				convert(&f, 0);
+			t = now() - t;
+			printf("%s %-7s %8.1f MPix/s  %s\n",
+			       step == 3 ? "rgb " : "rgba",
+			       computing_yuv_name(impl),
+			       (double)width * height * frames / t / 1e6,
+			       ok ? "exact" : "MISMATCH");
+			failed |= !ok;
+		}
+		frame_free(&ref);
+		frame_free(&f);
+	}
+	for (impl = COMPUTING_YUV_C; impl <= COMPUTING_YUV_AVX2; impl++) {
+		struct sharp ref, s;
+		double t;
+		int n, ok;
+
+		if (computing_yuv_init(impl) != impl)
+			continue;
+		if (sharp_alloc(&ref, width) != 0 ||
+		    sharp_alloc(&s, width) != 0) {
+			fprintf(stderr, "out of memory\n");
+			return 2;
+		}
+		computing_yuv_init(COMPUTING_YUV_C);
+		sharp_pass(&ref, 4);
+		computing_yuv_init(impl);
+		sharp_pass(&s, 4);
+		ok = sharp_same(&ref, &s);
+		t = now();
+		for (n = 0; n < frames; n++)
+			sharp_pass(&s, (height + 1) >> 1);
+		t = now() - t;
+		printf("sharp %-7s %8.1f MPix/s  %s\n",
+		       computing_yuv_name(impl),
+		       (double)width * height * frames / t / 1e6,
+		       ok ? "exact" : "MISMATCH");
+		failed |= !ok;
+		sharp_free(&ref);
+		sharp_free(&s);
+	}
+	return failed;
+}
@@ -18,6 +18,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <ctype.h>
+#include <limits.h>
 #include <png.h>
 #include <jpeglib.h>
 #include <jerror.h>
@@ -39,7 +41,16 @@
 #include <osnap_tools.h>
 #include <osnap_hls_if.h>
 
+#include <computing_cache.h>
 #include <computing_common.h>
+#include <computing_cpu.h>
+#include <computing_daemon.h>
+#include <computing_encode.h>
+#include <computing_pool.h>
+#include <computing_queue.h>
+#include <computing_rescale.h>
+#include <computing_writer.h>
+#include <computing_yuv.h>
 
 //typedef struct WebPConfig WebPConfig;
 typedef struct WebPPicture WebPPicture;   // main structure for I/O
@@ -143,6 +154,9 @@ struct WebPPicture {
   ////////////////////
   void* memory_;          // row chunk of memory for yuva planes
   void* memory_argb_;     // and for argb too.
+  uint8_t* tiles_;        // macroblock tiles in place of y/u/v, see
+                          // PictureAllocTiles()
+  int want_tiles_;        // the reader may decode into tiles_
   void* pad7[2];          // padding for later use
 };
 
@@ -512,6 +526,63 @@ static void HelpLong(void) {
   printf("  -af .................... auto-adjust filter strength\n");
   printf("  -pre <int> ............. pre-processing filter\n");
   printf("\n");
+  printf("FPGA options:\n");
+  printf("  -i <dir> ............... encode every file of <dir> into <dir>webp/\n");
+  printf("  -r ..................... also encode the sub-directories of -i\n");
+  printf("  -resize <w> <h> ........ rescale the inputs, 0 keeps the aspect\n"
+         "                           ratio; large JPEGs decode at 1/2..1/8\n");
+  printf("  -rendition <w> <h> <q> . one more output of every input, rescaled\n"
+         "                           as -resize and at quality <q>, named\n"
+         "                           <name>-<w>x<h>-q<q>.webp; up to 8, the\n"
+         "                           input is decoded once for all of them\n");
+  printf("  -yuv <i420|nv12> ....... the inputs are raw 4:2:0 frames\n");
+  printf("  -yuv_size <w> <h> ...... size of the raw frames, default is the\n"
+         "                           \"<w> <h>\" in <input>.size\n");
+  printf("  -list <file> ........... encode the files named in <file>, one per\n"
+         "                           line relative to -i, instead of listing -i\n");
+  printf("  -prefetch <int> ........ inputs read ahead of the decoders, default=16\n");
+  printf("  -C <int> ............... only use this card, default=all cards\n");
+  printf("  -t <int> ............... action timeout in seconds, default=60\n");
+  printf("  -I ..................... completion by interrupt instead of polling\n");
+  printf("  -depth <int> ........... jobs queued per card, default=4\n");
+  printf("  -spin <int> ............ busy-poll window in usec before sleeping\n"
+         "                           on the card, default=200\n");
+  printf("  -pool <int> ............ MiB of DMA buffers kept for reuse, default=256\n");
+  printf("  -hugepage .............. back large DMA buffers with huge pages\n");
+  printf("  -queue <int> ........... finished pictures waiting for the encoder,\n"
+         "                           default=16\n");
+  printf("  -mem <int> ............. MiB of pictures in flight before reading\n"
+         "                           stalls, default=1024\n");
+  printf("  -emit <int> ............ encoder threads after the card, default=4\n");
+  printf("  -ordered ............... write the outputs in input order\n");
+  printf("  -wqueue <int> .......... outputs waiting for the writer thread,\n"
+         "                           default=64\n");
+  printf("  -fsync <int> ........... fsync the outputs in batches of <int>\n"
+         "                           files, default=0 (no fsync)\n");
+  printf("  -pack <prefix> ......... append the outputs to <prefix>-NNNN.pack\n"
+         "                           with an index in <prefix>-NNNN.idx instead\n"
+         "                           of writing <dir>webp/, see computing_unpack\n");
+  printf("  -pack_mb <int> ......... start a new pack after <int> MiB,\n"
+         "                           default=0 (one pack)\n");
+  printf("  -cache <dir> ........... keep the outputs in <dir> by the hash of\n"
+         "                           the input and the settings, and take them\n"
+         "                           from there for inputs seen before\n");
+  printf("  -cache_mb <int> ........ size of the -cache in MiB, the least\n"
+         "                           recently used go first, default=1024\n");
+  printf("  -front <int> ........... decode/analyze threads before the card,\n"
+         "                           default=4\n");
+  printf("  -sharp_threads <int> ... threads on one picture for -sharp_yuv,\n"
+         "                           default=1\n");
+  printf("  -planar ................ read the pictures into Y/U/V planes, not\n"
+         "                           straight into the macroblock tiles\n");
+  printf("  -daemon <path> ......... serve encode requests on this Unix socket\n"
+         "                           instead of reading -i, see\n"
+         "                           computing_daemon.h\n");
+  printf("  -cpu <int> ............. host threads sharing the macroblock work\n"
+         "                           with the cards, default=0 (cards only)\n");
+  printf("  -rows <int> ............ threads on the macroblock rows of one\n"
+         "                           picture on the -cpu path, default=1\n");
+  printf("\n");
 }
 
 static uint32_t ExUtilGetUInt(const char* const v, int base, int* const error) {
@@ -677,6 +748,12 @@ typedef enum {
   WEBP_UNSUPPORTED_FORMAT
 } WebPInputFileFormat;
 
+typedef enum {
+  RAW_YUV_NONE = 0,
+  RAW_YUV_I420,
+  RAW_YUV_NV12
+} RawYUVFormat;
+
 static uint32_t GetBE32(const uint8_t buf[]) {
   return ((uint32_t)buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
 }
@@ -1117,44 +1194,47 @@ static volatile int kGammaTablesOk = 0;
 static uint32_t kLinearToGammaTabS[kGammaTabSize + 2];
 #define GAMMA_TO_LINEAR_BITS 14
 static uint32_t kGammaToLinearTabS[MAX_Y_T + 1];   // size scales with Y_FIX
-static volatile int kGammaTablesSOk = 0;
 
-static void InitGammaTablesS(void) {
-  assert(2 * GAMMA_TO_LINEAR_BITS < 32);  // we use uint32_t intermediate values
-  if (!kGammaTablesSOk) {
-    int v;
-    const double norm = 1. / MAX_Y_T;
-    const double scale = 1. / kGammaTabSize;
-    const double a = 0.09929682680944;
-    const double thresh = 0.018053968510807;
-    const double final_scale = 1 << GAMMA_TO_LINEAR_BITS;
-    for (v = 0; v <= MAX_Y_T; ++v) {
-      const double g = norm * v;
-      double value;
-      if (g <= thresh * 4.5) {
-        value = g / 4.5;
-      } else {
-        const double a_rec = 1. / (1. + a);
-        value = pow(a_rec * (g + a), kGammaF);
-      }
-      kGammaToLinearTabS[v] = (uint32_t)(value * final_scale + .5);
+// The sharp conversion runs on the front-end threads
+static pthread_once_t kGammaTablesSOnce = PTHREAD_ONCE_INIT;
+
+static void ComputeGammaTablesS(void) {
+  int v;
+  const double norm = 1. / MAX_Y_T;
+  const double scale = 1. / kGammaTabSize;
+  const double a = 0.09929682680944;
+  const double thresh = 0.018053968510807;
+  const double final_scale = 1 << GAMMA_TO_LINEAR_BITS;
+  for (v = 0; v <= MAX_Y_T; ++v) {
+    const double g = norm * v;
+    double value;
+    if (g <= thresh * 4.5) {
+      value = g / 4.5;
+    } else {
+      const double a_rec = 1. / (1. + a);
+      value = pow(a_rec * (g + a), kGammaF);
     }
-    for (v = 0; v <= kGammaTabSize; ++v) {
-      const double g = scale * v;
-      double value;
-      if (g <= thresh) {
-        value = 4.5 * g;
-      } else {
-        value = (1. + a) * pow(g, 1. / kGammaF) - a;
-      }
-      // we already incorporate the 1/2 rounding constant here
-      kLinearToGammaTabS[v] =
-          (uint32_t)(MAX_Y_T * value) + (1 << GAMMA_TO_LINEAR_BITS >> 1);
+    kGammaToLinearTabS[v] = (uint32_t)(value * final_scale + .5);
+  }
+  for (v = 0; v <= kGammaTabSize; ++v) {
+    const double g = scale * v;
+    double value;
+    if (g <= thresh) {
+      value = 4.5 * g;
+    } else {
+      value = (1. + a) * pow(g, 1. / kGammaF) - a;
     }
-    // to prevent small rounding errors to cause read-overflow:
-    kLinearToGammaTabS[kGammaTabSize + 1] = kLinearToGammaTabS[kGammaTabSize];
-    kGammaTablesSOk = 1;
+    // we already incorporate the 1/2 rounding constant here
+    kLinearToGammaTabS[v] =
+        (uint32_t)(MAX_Y_T * value) + (1 << GAMMA_TO_LINEAR_BITS >> 1);
   }
+  // to prevent small rounding errors to cause read-overflow:
+  kLinearToGammaTabS[kGammaTabSize + 1] = kLinearToGammaTabS[kGammaTabSize];
+}
+
+static void InitGammaTablesS(void) {
+  assert(2 * GAMMA_TO_LINEAR_BITS < 32);  // we use uint32_t intermediate values
+  pthread_once(&kGammaTablesSOnce, ComputeGammaTablesS);
 }
 
 static void InitGammaTables(void) {
@@ -1294,17 +1374,6 @@ static fixed_y_t Filter2(int A, int B, int W0) {
   return clip_y(v0 + W0);
 }
 
-static void SharpYUVFilterRow_C(const int16_t* A, const int16_t* B, int len,
-                                const uint16_t* best_y, uint16_t* out) {
-  int i;
-  for (i = 0; i < len; ++i, ++A, ++B) {
-    const int v0 = (A[0] * 9 + A[1] * 3 + B[0] * 3 + B[1] + 8) >> 4;
-    const int v1 = (A[1] * 9 + A[0] * 3 + B[1] * 3 + B[0] + 8) >> 4;
-    out[2 * i + 0] = clip_y(best_y[2 * i + 0] + v0);
-    out[2 * i + 1] = clip_y(best_y[2 * i + 1] + v1);
-  }
-}
-
 static void InterpolateTwoRows(const fixed_y_t* const best_y,
                                const fixed_t* prev_uv,
                                const fixed_t* cur_uv,
@@ -1320,8 +1389,8 @@ static void InterpolateTwoRows(const fixed_y_t* const best_y,
     out1[0] = Filter2(cur_uv[0], prev_uv[0], best_y[0]);
     out2[0] = Filter2(cur_uv[0], next_uv[0], best_y[w]);
 
-    SharpYUVFilterRow_C(cur_uv, prev_uv, len, best_y + 0 + 1, out1 + 1);
-    SharpYUVFilterRow_C(cur_uv, next_uv, len, best_y + w + 1, out2 + 1);
+    computing_sharp_filter_row(cur_uv, prev_uv, len, best_y + 0 + 1, out1 + 1);
+    computing_sharp_filter_row(cur_uv, next_uv, len, best_y + w + 1, out2 + 1);
 
     // special boundary case for i == w - 1 when w is even
     if (!(w & 1)) {
@@ -1338,28 +1407,6 @@ static void InterpolateTwoRows(const fixed_y_t* const best_y,
   }
 }
 
-static uint64_t SharpYUVUpdateY_C(const uint16_t* ref, const uint16_t* src,
-                                  uint16_t* dst, int len) {
-  uint64_t diff = 0;
-  int i;
-  for (i = 0; i < len; ++i) {
-    const int diff_y = ref[i] - src[i];
-    const int new_y = (int)dst[i] + diff_y;
-    dst[i] = clip_y(new_y);
-    diff += (uint64_t)abs(diff_y);
-  }
-  return diff;
-}
-
-static void SharpYUVUpdateRGB_C(const int16_t* ref, const int16_t* src,
-                                int16_t* dst, int len) {
-  int i;
-  for (i = 0; i < len; ++i) {
-    const int diff_uv = ref[i] - src[i];
-    dst[i] += diff_uv;
-  }
-}
-
 #define SROUNDER (1 << (YUV_FIX + SFIX - 1))
 
 static uint8_t clip_8b(fixed_t v) {
@@ -1421,56 +1468,66 @@ static int ConvertWRGBToYUV(const fixed_y_t* best_y, const fixed_t* best_uv,
   return 1;
 }
 
-static int PreprocessARGB(const uint8_t* r_ptr,
-                          const uint8_t* g_ptr,
-                          const uint8_t* b_ptr,
-                          int step, int rgb_stride,
-                          WebPPicture* const picture) {
-  // we expand the right/bottom border if needed
-  const int w = (picture->width + 1) & ~1;
-  const int h = (picture->height + 1) & ~1;
-  const int uv_w = w >> 1;
-  const int uv_h = h >> 1;
-  uint64_t prev_diff_y_sum = ~0;
-  int j, iter;
+// The sharp conversion runs on bands of kSharpBandRows rows, spread over
+// sharp_threads threads. The bands are the same for any number of threads,
+// so is the output. Within a pass a band starts from the chroma row above
+// it as it was before the pass, where the single loop of libwebp sees that
+// row already updated. Pictures of a single band convert as in libwebp.
+#define MAX_SHARP_THREADS 64
+static const int kSharpBandRows = 32;   // even
 
-  // TODO(skal): allocate one big memory chunk. But for now, it's easier
-  // for valgrind debugging to have several chunks.
-  fixed_y_t* const tmp_buffer = SAFE_ALLOC(w * 3, 2, fixed_y_t);   // scratch
-  fixed_y_t* const best_y_base = SAFE_ALLOC(w, h, fixed_y_t);
-  fixed_y_t* const target_y_base = SAFE_ALLOC(w, h, fixed_y_t);
-  fixed_y_t* const best_rgb_y = SAFE_ALLOC(w, 2, fixed_y_t);
-  fixed_t* const best_uv_base = SAFE_ALLOC(uv_w * 3, uv_h, fixed_t);
-  fixed_t* const target_uv_base = SAFE_ALLOC(uv_w * 3, uv_h, fixed_t);
-  fixed_t* const best_rgb_uv = SAFE_ALLOC(uv_w * 3, 1, fixed_t);
-  fixed_y_t* best_y = best_y_base;
-  fixed_y_t* target_y = target_y_base;
-  fixed_t* best_uv = best_uv_base;
-  fixed_t* target_uv = target_uv_base;
-  const uint64_t diff_y_threshold = (uint64_t)(3.0 * w * h);
-  int ok;
+static int sharp_yuv = 0;       // -sharp_yuv: iterative RGB->YUV of RGB inputs
+static int sharp_threads = 1;   // threads on the bands of one picture
 
-  if (best_y_base == NULL || best_uv_base == NULL ||
-      target_y_base == NULL || target_uv_base == NULL ||
-      best_rgb_y == NULL || best_rgb_uv == NULL ||
-      tmp_buffer == NULL) {
-    ok = WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
-    goto End;
-  }
-  assert(picture->width >= kMinDimensionIterativeConversion);
-  assert(picture->height >= kMinDimensionIterativeConversion);
+typedef struct {
+  const uint8_t* r_ptr;
+  const uint8_t* g_ptr;
+  const uint8_t* b_ptr;
+  int step, rgb_stride;
+  int width, height;       // of the picture
+  int w, h, uv_w;          // rounded up to even
+  int num_bands;
+  int pass;                // -1: import of the RGB samples
+  fixed_y_t* best_y;
+  fixed_y_t* target_y;
+  fixed_t* best_uv;
+  fixed_t* target_uv;
+  fixed_t* edge_uv;        // per band the chroma rows above and below it
+  uint64_t* diff_y;        // per band, of the current pass
+  fixed_y_t* scratch;      // per thread
+  size_t scratch_size;
+  int next_band;
+  int next_scratch;
+} SharpJob;
+
+// Import RGB samples to W/RGB representation.
+static void SharpImportBand(const SharpJob* const job, int band,
+                            fixed_y_t* const tmp_buffer) {
+  const int w = job->w;
+  const int uv_w = job->uv_w;
+  const int j0 = band * kSharpBandRows;
+  const int j1 = (j0 + kSharpBandRows < job->height)
+               ? j0 + kSharpBandRows : job->height;
+  const int rgb_stride = job->rgb_stride;
+  const uint8_t* r_ptr = job->r_ptr + (size_t)j0 * rgb_stride;
+  const uint8_t* g_ptr = job->g_ptr + (size_t)j0 * rgb_stride;
+  const uint8_t* b_ptr = job->b_ptr + (size_t)j0 * rgb_stride;
+  fixed_y_t* best_y = job->best_y + (size_t)j0 * w;
+  fixed_y_t* target_y = job->target_y + (size_t)j0 * w;
+  fixed_t* best_uv = job->best_uv + (size_t)(j0 >> 1) * 3 * uv_w;
+  fixed_t* target_uv = job->target_uv + (size_t)(j0 >> 1) * 3 * uv_w;
+  int j;
 
-  // Import RGB samples to W/RGB representation.
-  for (j = 0; j < picture->height; j += 2) {
-    const int is_last_row = (j == picture->height - 1);
+  for (j = j0; j < j1; j += 2) {
+    const int is_last_row = (j == job->height - 1);
     fixed_y_t* const src1 = tmp_buffer + 0 * w;
     fixed_y_t* const src2 = tmp_buffer + 3 * w;
 
     // prepare two rows of input
-    ImportOneRow(r_ptr, g_ptr, b_ptr, step, picture->width, src1);
+    ImportOneRow(r_ptr, g_ptr, b_ptr, job->step, job->width, src1);
     if (!is_last_row) {
       ImportOneRow(r_ptr + rgb_stride, g_ptr + rgb_stride, b_ptr + rgb_stride,
-                   step, picture->width, src2);
+                   job->step, job->width, src2);
     } else {
       memcpy(src2, src1, 3 * w * sizeof(*src2));
     }
@@ -1489,40 +1546,175 @@ static int PreprocessARGB(const uint8_t* r_ptr,
     g_ptr += 2 * rgb_stride;
     b_ptr += 2 * rgb_stride;
   }
+}
+
+// One pass over a band to resolve clipping conflicts, returns the sum of
+// the luma corrections.
+static uint64_t SharpPassBand(const SharpJob* const job, int band,
+                              fixed_y_t* const tmp_buffer) {
+  const int w = job->w;
+  const int h = job->h;
+  const int uv_w = job->uv_w;
+  const int j0 = band * kSharpBandRows;
+  const int j1 = (j0 + kSharpBandRows < h) ? j0 + kSharpBandRows : h;
+  const fixed_t* const edge_uv = job->edge_uv + (size_t)band * 6 * uv_w;
+  fixed_y_t* const src1 = tmp_buffer + 0 * w;
+  fixed_y_t* const src2 = tmp_buffer + 3 * w;
+  fixed_y_t* const best_rgb_y = tmp_buffer + 6 * w;
+  fixed_t* const best_rgb_uv = (fixed_t*)(tmp_buffer + 8 * w);
+  fixed_y_t* best_y = job->best_y + (size_t)j0 * w;
+  fixed_y_t* target_y = job->target_y + (size_t)j0 * w;
+  fixed_t* best_uv = job->best_uv + (size_t)(j0 >> 1) * 3 * uv_w;
+  fixed_t* target_uv = job->target_uv + (size_t)(j0 >> 1) * 3 * uv_w;
+  const fixed_t* prev_uv = (j0 > 0) ? edge_uv : best_uv;
+  uint64_t diff_y_sum = 0;
+  int j;
+
+  for (j = j0; j < j1; j += 2) {
+    const fixed_t* const next_uv =
+        (j >= h - 2) ? best_uv :
+        (j + 2 < j1) ? best_uv + 3 * uv_w : edge_uv + 3 * uv_w;
+    InterpolateTwoRows(best_y, prev_uv, best_uv, next_uv, w, src1, src2);
+    prev_uv = best_uv;
+
+    UpdateW(src1, best_rgb_y + 0 * w, w);
+    UpdateW(src2, best_rgb_y + 1 * w, w);
+    UpdateChroma(src1, src2, best_rgb_uv, uv_w);
+
+    // update two rows of Y and one row of RGB
+    diff_y_sum += computing_sharp_update_y(target_y, best_rgb_y, best_y,
+                                           2 * w);
+    computing_sharp_update_rgb(target_uv, best_rgb_uv, best_uv, 3 * uv_w);
+
+    best_y += 2 * w;
+    best_uv += 3 * uv_w;
+    target_y += 2 * w;
+    target_uv += 3 * uv_w;
+  }
+  return diff_y_sum;
+}
+
+static void* SharpThread(void* arg) {
+  SharpJob* const job = (SharpJob*)arg;
+  const int t = __atomic_fetch_add(&job->next_scratch, 1, __ATOMIC_RELAXED);
+  fixed_y_t* const tmp_buffer = job->scratch + t * job->scratch_size;
+  int band;
+
+  while ((band = __atomic_fetch_add(&job->next_band, 1,
+                                    __ATOMIC_RELAXED)) < job->num_bands) {
+    if (job->pass < 0) {
+      SharpImportBand(job, band, tmp_buffer);
+    } else {
+      job->diff_y[band] = SharpPassBand(job, band, tmp_buffer);
+    }
+  }
+  return NULL;
+}
+
+// Runs the bands of job->pass, the caller is one of the threads.
+static void SharpRun(SharpJob* const job, int threads) {
+  pthread_t tid[MAX_SHARP_THREADS];
+  int started = 0;
+  int i;
+
+  job->next_band = 0;
+  job->next_scratch = 0;
+  for (i = 0; i < threads - 1; ++i) {
+    if (pthread_create(&tid[i], NULL, SharpThread, job) != 0) break;
+    ++started;
+  }
+  SharpThread(job);
+  for (i = 0; i < started; ++i) {
+    pthread_join(tid[i], NULL);
+  }
+}
+
+static int PreprocessARGB(const uint8_t* r_ptr,
+                          const uint8_t* g_ptr,
+                          const uint8_t* b_ptr,
+                          int step, int rgb_stride,
+                          WebPPicture* const picture) {
+  // we expand the right/bottom border if needed
+  const int w = (picture->width + 1) & ~1;
+  const int h = (picture->height + 1) & ~1;
+  const int uv_w = w >> 1;
+  const int uv_h = h >> 1;
+  const int num_bands = (h + kSharpBandRows - 1) / kSharpBandRows;
+  const int threads = (sharp_threads > num_bands) ? num_bands :
+                      (sharp_threads < 1) ? 1 : sharp_threads;
+  // per thread: two rows of R/G/B, two of W and one of R/G/B chroma
+  const size_t scratch_size = 8 * (size_t)w + 3 * (size_t)uv_w;
+  uint64_t prev_diff_y_sum = ~0;
+  int b, iter;
+
+  fixed_y_t* const scratch = SAFE_ALLOC(scratch_size, threads, fixed_y_t);
+  fixed_y_t* const best_y_base = SAFE_ALLOC(w, h, fixed_y_t);
+  fixed_y_t* const target_y_base = SAFE_ALLOC(w, h, fixed_y_t);
+  fixed_t* const best_uv_base = SAFE_ALLOC(uv_w * 3, uv_h, fixed_t);
+  fixed_t* const target_uv_base = SAFE_ALLOC(uv_w * 3, uv_h, fixed_t);
+  fixed_t* const edge_uv = SAFE_ALLOC(uv_w * 6, num_bands, fixed_t);
+  uint64_t* const diff_y = SAFE_ALLOC(num_bands, 1, uint64_t);
+  const uint64_t diff_y_threshold = (uint64_t)(3.0 * w * h);
+  SharpJob job;
+  int ok;
+
+  if (best_y_base == NULL || best_uv_base == NULL ||
+      target_y_base == NULL || target_uv_base == NULL ||
+      scratch == NULL || edge_uv == NULL || diff_y == NULL) {
+    ok = WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    goto End;
+  }
+  assert(picture->width >= kMinDimensionIterativeConversion);
+  assert(picture->height >= kMinDimensionIterativeConversion);
+
+  memset(&job, 0, sizeof(job));
+  job.r_ptr = r_ptr;
+  job.g_ptr = g_ptr;
+  job.b_ptr = b_ptr;
+  job.step = step;
+  job.rgb_stride = rgb_stride;
+  job.width = picture->width;
+  job.height = picture->height;
+  job.w = w;
+  job.h = h;
+  job.uv_w = uv_w;
+  job.num_bands = num_bands;
+  job.best_y = best_y_base;
+  job.target_y = target_y_base;
+  job.best_uv = best_uv_base;
+  job.target_uv = target_uv_base;
+  job.edge_uv = edge_uv;
+  job.diff_y = diff_y;
+  job.scratch = scratch;
+  job.scratch_size = scratch_size;
+
+  job.pass = -1;
+  SharpRun(&job, threads);
 
   // Iterate and resolve clipping conflicts.
   for (iter = 0; iter < kNumIterations; ++iter) {
-    const fixed_t* cur_uv = best_uv_base;
-    const fixed_t* prev_uv = best_uv_base;
     uint64_t diff_y_sum = 0;
 
-    best_y = best_y_base;
-    best_uv = best_uv_base;
-    target_y = target_y_base;
-    target_uv = target_uv_base;
-    for (j = 0; j < h; j += 2) {
-      fixed_y_t* const src1 = tmp_buffer + 0 * w;
-      fixed_y_t* const src2 = tmp_buffer + 3 * w;
-      {
-        const fixed_t* const next_uv = cur_uv + ((j < h - 2) ? 3 * uv_w : 0);
-        InterpolateTwoRows(best_y, prev_uv, cur_uv, next_uv, w, src1, src2);
-        prev_uv = cur_uv;
-        cur_uv = next_uv;
+    // the neighbour rows of every band, before the pass
+    for (b = 0; b < num_bands; ++b) {
+      const int uv_y0 = b * kSharpBandRows / 2;
+      const int uv_y1 = uv_y0 + kSharpBandRows / 2;
+      fixed_t* const edge = edge_uv + (size_t)b * 6 * uv_w;
+      if (b > 0) {
+        memcpy(edge, best_uv_base + (size_t)(uv_y0 - 1) * 3 * uv_w,
+               3 * uv_w * sizeof(*edge));
       }
-
-      UpdateW(src1, best_rgb_y + 0 * w, w);
-      UpdateW(src2, best_rgb_y + 1 * w, w);
-      UpdateChroma(src1, src2, best_rgb_uv, uv_w);
-
-      // update two rows of Y and one row of RGB
-      diff_y_sum += SharpYUVUpdateY_C(target_y, best_rgb_y, best_y, 2 * w);
-      SharpYUVUpdateRGB_C(target_uv, best_rgb_uv, best_uv, 3 * uv_w);
-
-      best_y += 2 * w;
-      best_uv += 3 * uv_w;
-      target_y += 2 * w;
-      target_uv += 3 * uv_w;
+      if (uv_y1 < uv_h) {
+        memcpy(edge + 3 * uv_w, best_uv_base + (size_t)uv_y1 * 3 * uv_w,
+               3 * uv_w * sizeof(*edge));
+      }
+    }
+    job.pass = iter;
+    SharpRun(&job, threads);
+    for (b = 0; b < num_bands; ++b) {
+      diff_y_sum += diff_y[b];
     }
+
     // test exit condition
     if (iter > 0) {
       if (diff_y_sum < diff_y_threshold) break;
@@ -1538,9 +1730,9 @@ static int PreprocessARGB(const uint8_t* r_ptr,
   WebPSafeFree(best_uv_base);
   WebPSafeFree(target_y_base);
   WebPSafeFree(target_uv_base);
-  WebPSafeFree(best_rgb_y);
-  WebPSafeFree(best_rgb_uv);
-  WebPSafeFree(tmp_buffer);
+  WebPSafeFree(edge_uv);
+  WebPSafeFree(diff_y);
+  WebPSafeFree(scratch);
   return ok;
 }
 
@@ -1602,20 +1794,6 @@ static int VP8RGBToY(int r, int g, int b, int rounding) {
   return (luma + rounding + (16 << YUV_FIX)) >> YUV_FIX;  // no need to clip
 }
 
-static void ConvertRGB24ToY_C(const uint8_t* rgb, uint8_t* y, int width) {
-  int i;
-  for (i = 0; i < width; ++i, rgb += 3) {
-    y[i] = VP8RGBToY(rgb[0], rgb[1], rgb[2], YUV_HALF);
-  }
-}
-
-static void ConvertBGR24ToY_C(const uint8_t* bgr, uint8_t* y, int width) {
-  int i;
-  for (i = 0; i < width; ++i, bgr += 3) {
-    y[i] = VP8RGBToY(bgr[2], bgr[1], bgr[0], YUV_HALF);
-  }
-}
-
 static int VP8RandomBits2(VP8Random* const rg, int num_bits,
                                       int amp) {
   int diff;
@@ -1641,6 +1819,15 @@ static int RGBToY(int r, int g, int b, VP8Random* const rg) {
                       : VP8RGBToY(r, g, b, VP8RandomBits(rg, YUV_FIX));
 }
 
+// True for the bytes of packed RGB(A) or BGR(A) pixels, which the
+// computing_yuv.h kernels take.
+static int IsPackedRGB(const uint8_t* const r_ptr,
+                       const uint8_t* const g_ptr,
+                       const uint8_t* const b_ptr, int step) {
+  return (step == 3 || step == 4) && g_ptr == r_ptr + 1 &&
+         (b_ptr == r_ptr + 2 || b_ptr + 2 == r_ptr);
+}
+
 static void ConvertRowToY(const uint8_t* const r_ptr,
                                       const uint8_t* const g_ptr,
                                       const uint8_t* const b_ptr,
@@ -1649,6 +1836,11 @@ static void ConvertRowToY(const uint8_t* const r_ptr,
                                       int width,
                                       VP8Random* const rg) {
   int i, j;
+  if (rg == NULL && IsPackedRGB(r_ptr, g_ptr, b_ptr, step)) {
+    const int swap_rb = (b_ptr < r_ptr);
+    computing_rgb_to_y(swap_rb ? b_ptr : r_ptr, step, swap_rb, dst_y, width);
+    return;
+  }
   for (i = 0, j = 0; i < width; i += 1, j += step) {
     dst_y[i] = RGBToY(r_ptr[j], g_ptr[j], b_ptr[j], rg);
   }
@@ -1688,6 +1880,12 @@ static void AccumulateRGB(const uint8_t* const r_ptr,
                                       int step, int rgb_stride,
                                       uint16_t* dst, int width) {
   int i, j;
+  if (IsPackedRGB(r_ptr, g_ptr, b_ptr, step)) {
+    const int swap_rb = (b_ptr < r_ptr);
+    computing_rgb_accumulate(swap_rb ? b_ptr : r_ptr, step, swap_rb,
+                             rgb_stride, dst, width);
+    return;
+  }
   for (i = 0, j = 0; i < (width >> 1); i += 1, j += 2 * step, dst += 4) {
     dst[0] = SUM4(r_ptr + j, step);
     dst[1] = SUM4(g_ptr + j, step);
@@ -1914,16 +2112,6 @@ static int VP8RGBToV(int r, int g, int b, int rounding) {
   return VP8ClipUV(v, rounding);
 }
 
-static void WebPConvertRGBA32ToUV_C(const uint16_t* rgb,
-                             uint8_t* u, uint8_t* v, int width) {
-  int i;
-  for (i = 0; i < width; i += 1, rgb += 4) {
-    const int r = rgb[0], g = rgb[1], b = rgb[2];
-    u[i] = VP8RGBToU(r, g, b, YUV_HALF << 2);
-    v[i] = VP8RGBToV(r, g, b, YUV_HALF << 2);
-  }
-}
-
 static int RGBToU(int r, int g, int b, VP8Random* const rg) {
   return (rg == NULL) ? VP8RGBToU(r, g, b, YUV_HALF << 2)
                       : VP8RGBToU(r, g, b, VP8RandomBits(rg, YUV_FIX + 2));
@@ -2016,13 +2204,13 @@ static int ImportYUVAFromRGBA(const uint8_t* r_ptr,
       int rows_have_alpha = has_alpha;
       if (use_dsp) {
         if (is_rgb) {
-        	ConvertRGB24ToY_C(r_ptr, dst_y, width);
-        	ConvertRGB24ToY_C(r_ptr + rgb_stride,
-                              dst_y + picture->y_stride, width);
+        	computing_rgb_to_y(r_ptr, 3, 0, dst_y, width);
+        	computing_rgb_to_y(r_ptr + rgb_stride, 3, 0,
+                               dst_y + picture->y_stride, width);
         } else {
-        	ConvertBGR24ToY_C(b_ptr, dst_y, width);
-        	ConvertBGR24ToY_C(b_ptr + rgb_stride,
-                              dst_y + picture->y_stride, width);
+        	computing_rgb_to_y(b_ptr, 3, 1, dst_y, width);
+        	computing_rgb_to_y(b_ptr + rgb_stride, 3, 1,
+                               dst_y + picture->y_stride, width);
         }
       } else {
         ConvertRowToY(r_ptr, g_ptr, b_ptr, step, dst_y, width, rg);
@@ -2045,7 +2233,7 @@ static int ImportYUVAFromRGBA(const uint8_t* r_ptr,
       }
       // Convert to U/V
       if (rg == NULL) {
-    	  WebPConvertRGBA32ToUV_C(tmp_rgb, dst_u, dst_v, uv_width);
+    	  computing_rgb_to_uv(tmp_rgb, dst_u, dst_v, uv_width);
       } else {
         ConvertRowsToUV(tmp_rgb, dst_u, dst_v, uv_width, rg);
       }
@@ -2060,9 +2248,9 @@ static int ImportYUVAFromRGBA(const uint8_t* r_ptr,
       int row_has_alpha = has_alpha;
       if (use_dsp) {
         if (r_ptr < b_ptr) {
-        	ConvertRGB24ToY_C(r_ptr, dst_y, width);
+        	computing_rgb_to_y(r_ptr, 3, 0, dst_y, width);
         } else {
-        	ConvertBGR24ToY_C(b_ptr, dst_y, width);
+        	computing_rgb_to_y(b_ptr, 3, 1, dst_y, width);
         }
       } else {
         ConvertRowToY(r_ptr, g_ptr, b_ptr, step, dst_y, width, rg);
@@ -2080,7 +2268,7 @@ static int ImportYUVAFromRGBA(const uint8_t* r_ptr,
                        tmp_rgb, width);
       }
       if (rg == NULL) {
-    	  WebPConvertRGBA32ToUV_C(tmp_rgb, dst_u, dst_v, uv_width);
+    	  computing_rgb_to_uv(tmp_rgb, dst_u, dst_v, uv_width);
       } else {
         ConvertRowsToUV(tmp_rgb, dst_u, dst_v, uv_width, rg);
       }
@@ -2105,6 +2293,8 @@ static void WebPPictureFree(WebPPicture* picture) {
   if (picture != NULL) {
     WebPSafeFree(picture->memory_);
     WebPSafeFree(picture->memory_argb_);
+    computing_pool_free(picture->tiles_);
+    picture->tiles_ = NULL;
     WebPPictureResetBuffers(picture);
   }
 }
@@ -2206,7 +2396,7 @@ static int Import(WebPPicture* const picture,
   if (!picture->use_argb) {
     const uint8_t* a_ptr = import_alpha ? rgb + 3 : NULL;
     return ImportYUVAFromRGBA(r_ptr, g_ptr, b_ptr, a_ptr, step, rgb_stride,
-                              0.f /* no dithering */, 0, picture);
+                              0.f /* no dithering */, sharp_yuv, picture);
   }
   if (!WebPPictureAlloc(picture)) return 0;
 
@@ -2259,6 +2449,297 @@ static int WebPPictureImportRGB(WebPPicture* picture,
              : 0;
 }
 
+// JFIF YCbCr is full range, the encoder takes BT.601 studio range:
+// Y 16..235 and U/V 16..240, with 16.16 fixed point rounding.
+#define JPEG_TO_Y(v)  (((v) * 56283 + (16 << 16) + (1 << 15)) >> 16)
+#define JPEG_TO_UV(v) (((v) * 57569 + 1019793 + (1 << 15)) >> 16)
+
+#if JPEG_LIB_VERSION >= 70
+#define JPEG_DCT_ROWS(c) ((c)->DCT_v_scaled_size)
+#else
+#define JPEG_DCT_ROWS(c) ((c)->DCT_scaled_size)
+#endif
+
+// -resize: the pictures are rescaled to this size once read, see
+// PictureResize(). JPEGs are already decoded at 1/2, 1/4 or 1/8 scale
+// when that is still at least as large.
+static int resize_width = 0;
+static int resize_height = 0;
+
+// Size of a width x height input rescaled to target_w x target_h: 0 in one
+// dimension keeps the aspect ratio, 0 in both keeps the input size.
+static void ScaleTarget(int width, int height, int target_w, int target_h,
+                        int* const w, int* const h) {
+  *w = target_w;
+  *h = target_h;
+  if (*w == 0 && *h == 0) {
+    *w = width;
+    *h = height;
+  } else if (*w == 0) {
+    *w = (int)(((int64_t)width * *h + height / 2) / height);
+  } else if (*h == 0) {
+    *h = (int)(((int64_t)height * *w + width / 2) / width);
+  }
+  if (*w < 1) *w = 1;
+  if (*h < 1) *h = 1;
+}
+
+// Size of a width x height input after -resize.
+static void ResizeTarget(int width, int height, int* const w, int* const h) {
+  ScaleTarget(width, height, resize_width, resize_height, w, h);
+}
+
+// Rescales the YUV(A) planes of 'pic' into a new picture 'dst' of w x h.
+static int PictureRescaleInto(const WebPPicture* const pic,
+                              WebPPicture* const dst, int w, int h) {
+  WebPPicture tmp = *pic;
+  int ok;
+
+  if (pic->use_argb) return 0;
+
+  tmp.width = w;
+  tmp.height = h;
+  tmp.memory_ = NULL;
+  tmp.memory_argb_ = NULL;
+  tmp.tiles_ = NULL;
+  tmp.argb = NULL;
+  tmp.y = tmp.u = tmp.v = tmp.a = NULL;
+  if (!WebPPictureAlloc(&tmp)) return 0;
+  ok = computing_rescale_plane(pic->y, pic->width, pic->height, pic->y_stride,
+                               tmp.y, w, h, tmp.y_stride) == 0 &&
+       computing_rescale_plane(pic->u, (pic->width + 1) >> 1,
+                               (pic->height + 1) >> 1, pic->uv_stride,
+                               tmp.u, (w + 1) >> 1, (h + 1) >> 1,
+                               tmp.uv_stride) == 0 &&
+       computing_rescale_plane(pic->v, (pic->width + 1) >> 1,
+                               (pic->height + 1) >> 1, pic->uv_stride,
+                               tmp.v, (w + 1) >> 1, (h + 1) >> 1,
+                               tmp.uv_stride) == 0 &&
+       (pic->a == NULL ||
+        computing_rescale_plane(pic->a, pic->width, pic->height, pic->a_stride,
+                                tmp.a, w, h, tmp.a_stride) == 0);
+  if (!ok) {
+    WebPPictureFree(&tmp);
+    return 0;
+  }
+  *dst = tmp;
+  return 1;
+}
+
+// Rescales the YUV(A) planes of 'pic' to w x h.
+static int PictureRescale(WebPPicture* const pic, int w, int h) {
+  WebPPicture tmp;
+
+  if (w == pic->width && h == pic->height) return 1;
+  if (!PictureRescaleInto(pic, &tmp, w, h)) return 0;
+  WebPPictureFree(pic);
+  *pic = tmp;
+  return 1;
+}
+
+// Rescales 'pic' to the -resize target, if any.
+static int PictureResize(WebPPicture* const pic) {
+  int w, h;
+  ResizeTarget(pic->width, pic->height, &w, &h);
+  return PictureRescale(pic, w, h);
+}
+
+//------------------------------------------------------------------------------
+// Macroblock tiles
+//
+// The action reads the picture as 384 byte tiles behind a 128 byte header:
+// 16 rows of 16 Y, then 8 rows of 8 U and 8 V, the picture edges
+// replicated into the partial macroblocks (see EncodeJobPrepare()). An
+// opaque picture that goes to the card as it is read can be decoded into
+// the tiles directly: pic->tiles_ then takes the place of the y/u/v
+// planes, which are never allocated, and becomes the input of the job.
+
+static int mb_tiles = 1;   // 0 with -planar
+
+// Allocates the tiles for pic->width x pic->height.
+static int PictureAllocTiles(WebPPicture* const pic) {
+  const int mb_w = (pic->width + 15) >> 4;
+  const int mb_h = (pic->height + 15) >> 4;
+  WebPPictureFree(pic);
+  pic->use_argb = 0;
+  pic->colorspace = WEBP_YUV420;
+  pic->tiles_ =
+      (uint8_t*)computing_pool_alloc((size_t)mb_w * mb_h * 384 + 128);
+  return (pic->tiles_ != NULL);
+}
+
+// Stores the luma row 'y'.
+static void TileRowY(const WebPPicture* const pic, int y,
+                     const uint8_t* const row) {
+  const int width = pic->width;
+  const size_t mb_w = (width + 15) >> 4;
+  uint8_t* dst = pic->tiles_ + 128 + (y >> 4) * mb_w * 384 + (y & 15) * 16;
+  int x;
+  for (x = 0; x + 16 <= width; x += 16, dst += 384) {
+    memcpy(dst, row + x, 16);
+  }
+  if (x < width) {
+    memcpy(dst, row + x, width - x);
+    memset(dst + width - x, row[width - 1], 16 - (width - x));
+  }
+}
+
+// Stores the chroma row 'y' of U and V.
+static void TileRowUV(const WebPPicture* const pic, int y,
+                      const uint8_t* const u, const uint8_t* const v) {
+  const int uv_width = (pic->width + 1) >> 1;
+  const size_t mb_w = (pic->width + 15) >> 4;
+  uint8_t* dst =
+      pic->tiles_ + 128 + (y >> 3) * mb_w * 384 + 256 + (y & 7) * 16;
+  int x;
+  for (x = 0; x + 8 <= uv_width; x += 8, dst += 384) {
+    memcpy(dst + 0, u + x, 8);
+    memcpy(dst + 8, v + x, 8);
+  }
+  if (x < uv_width) {
+    const int n = uv_width - x;
+    memcpy(dst + 0, u + x, n);
+    memset(dst + 0 + n, u[uv_width - 1], 8 - n);
+    memcpy(dst + 8, v + x, n);
+    memset(dst + 8 + n, v[uv_width - 1], 8 - n);
+  }
+}
+
+// Replicates the last rows into the bottom macroblocks, once every row is
+// stored.
+static void TileFinish(const WebPPicture* const pic) {
+  const int mb_w = (pic->width + 15) >> 4;
+  const int mb_h = (pic->height + 15) >> 4;
+  const int h = pic->height - (mb_h - 1) * 16;
+  const int uv_h = (h + 1) >> 1;
+  uint8_t* tile = pic->tiles_ + 128 + (size_t)(mb_h - 1) * mb_w * 384;
+  int x, i;
+  for (x = 0; x < mb_w; ++x, tile += 384) {
+    for (i = h; i < 16; ++i) {
+      memcpy(tile + i * 16, tile + (i - 1) * 16, 16);
+    }
+    for (i = uv_h; i < 8; ++i) {
+      memcpy(tile + 256 + i * 16, tile + 256 + (i - 1) * 16, 16);
+    }
+  }
+}
+
+// A YCbCr JPEG with 2x2 subsampled chroma: libjpeg's own planes are
+// already the 4:2:0 layout of the picture.
+static int IsJPEGYUV420(const struct jpeg_decompress_struct* const dinfo) {
+  const jpeg_component_info* const c = dinfo->comp_info;
+  return dinfo->num_components == 3 &&
+         dinfo->jpeg_color_space == JCS_YCbCr &&
+         c[0].h_samp_factor == 2 && c[0].v_samp_factor == 2 &&
+         c[1].h_samp_factor == 1 && c[1].v_samp_factor == 1 &&
+         c[2].h_samp_factor == 1 && c[2].v_samp_factor == 1;
+}
+
+static void JPEGRowToY(const uint8_t* src, uint8_t* dst, int width) {
+  int x;
+  for (x = 0; x < width; ++x) dst[x] = JPEG_TO_Y(src[x]);
+}
+
+static void JPEGRowToUV(const uint8_t* src, uint8_t* dst, int width) {
+  int x;
+  for (x = 0; x < width; ++x) dst[x] = JPEG_TO_UV(src[x]);
+}
+
+// Same from two rows of chroma at the luma resolution, 'width' is the
+// luma width.
+static void JPEGRowsToUV(const uint8_t* src0, const uint8_t* src1,
+                         uint8_t* dst, int width) {
+  int x;
+  for (x = 0; x < (width >> 1); ++x) {
+    const int sum = src0[2 * x] + src0[2 * x + 1] +
+                    src1[2 * x] + src1[2 * x + 1];
+    dst[x] = JPEG_TO_UV((sum + 2) >> 2);
+  }
+  if (width & 1) {
+    dst[x] = JPEG_TO_UV((src0[2 * x] + src1[2 * x] + 1) >> 1);
+  }
+}
+
+// Decodes a 4:2:0 JPEG with raw_data_out into the Y/U/V planes of 'pic'.
+// libjpeg writes whole DCT blocks, so every iMCU row lands in a strip of
+// block aligned rows first and is range mapped from there into the
+// picture: no RGB image, no upsampling and no downsampling. When the DCT
+// scaling leaves the chroma at the luma resolution, it is averaged 2x2.
+// With pic->want_tiles_ the rows are mapped into one line each and stored
+// as macroblock tiles instead.
+static int ReadJPEGYUV420(j_decompress_ptr dinfo, WebPPicture* const pic,
+                          uint8_t* volatile* const strip) {
+  const int tiled = pic->want_tiles_;
+  int rows[3], stride[3], c, y;
+  uint8_t* line;
+  size_t size = 0;
+  JSAMPROW row[3][4 * DCTSIZE];
+  JSAMPARRAY planes[3];
+  uint8_t* base;
+
+  dinfo->raw_data_out = TRUE;
+  dinfo->out_color_space = JCS_YCbCr;
+  jpeg_start_decompress(dinfo);
+
+  for (c = 0; c < 3; ++c) {
+    const jpeg_component_info* const comp = &dinfo->comp_info[c];
+    rows[c] = comp->v_samp_factor * JPEG_DCT_ROWS(comp);
+    stride[c] = (comp->width_in_blocks + comp->h_samp_factor) * DCTSIZE;
+    if (rows[c] > 4 * DCTSIZE) return 0;
+    size += (size_t)rows[c] * stride[c];
+  }
+  if (rows[1] != rows[2] || (rows[1] != rows[0] && 2 * rows[1] != rows[0])) {
+    return 0;
+  }
+  pic->width = dinfo->output_width;
+  pic->height = dinfo->output_height;
+  pic->use_argb = 0;
+  pic->colorspace = WEBP_YUV420;
+  if (tiled ? !PictureAllocTiles(pic) : !WebPPictureAlloc(pic)) return 0;
+
+  // behind the strip a line of Y, or of U and V
+  *strip = (uint8_t*)malloc(size + (size_t)pic->width + 1);
+  if (*strip == NULL) return 0;
+  base = *strip;
+  for (c = 0; c < 3; ++c) {
+    for (y = 0; y < rows[c]; ++y) row[c][y] = base + (size_t)y * stride[c];
+    base += (size_t)rows[c] * stride[c];
+    planes[c] = row[c];
+  }
+  line = base;
+
+  while (dinfo->output_scanline < dinfo->output_height) {
+    const int y0 = dinfo->output_scanline;
+    const int n = (int)jpeg_read_raw_data(dinfo, planes, rows[0]);
+    const int uv_w = (pic->width + 1) >> 1;
+    const int uv_h = (pic->height + 1) >> 1;
+    if (n <= 0) return 0;
+    for (y = 0; y < n && y0 + y < pic->height; ++y) {
+      uint8_t* const dst =
+          tiled ? line : pic->y + (size_t)(y0 + y) * pic->y_stride;
+      JPEGRowToY(row[0][y], dst, pic->width);
+      if (tiled) TileRowY(pic, y0 + y, dst);
+    }
+    for (y = 0; y < (n + 1) / 2 && y0 / 2 + y < uv_h; ++y) {
+      const size_t off = (size_t)(y0 / 2 + y) * pic->uv_stride;
+      uint8_t* const dst_u = tiled ? line : pic->u + off;
+      uint8_t* const dst_v = tiled ? line + uv_w : pic->v + off;
+      if (rows[1] != rows[0]) {
+        JPEGRowToUV(row[1][y], dst_u, uv_w);
+        JPEGRowToUV(row[2][y], dst_v, uv_w);
+      } else {
+        const int y1 = (2 * y + 1 < n && y0 + 2 * y + 1 < pic->height)
+                     ? 2 * y + 1 : 2 * y;
+        JPEGRowsToUV(row[1][2 * y], row[1][y1], dst_u, pic->width);
+        JPEGRowsToUV(row[2][2 * y], row[2][y1], dst_v, pic->width);
+      }
+      if (tiled) TileRowUV(pic, y0 / 2 + y, dst_u, dst_v);
+    }
+  }
+  if (tiled) TileFinish(pic);
+  return 1;
+}
+
 static int ReadJPEG(const uint8_t* const data, size_t data_size,
              WebPPicture* const pic, int keep_alpha,
              Metadata* const metadata) {
@@ -2268,6 +2749,7 @@ static int ReadJPEG(const uint8_t* const data, size_t data_size,
   volatile struct jpeg_decompress_struct dinfo;
   struct my_error_mgr jerr;
   uint8_t* volatile rgb = NULL;
+  volatile int target_w = 0, target_h = 0;   // -resize, from the unscaled size
   JSAMPROW buffer[1];
   JPEGReadContext ctx;
 
@@ -2294,6 +2776,35 @@ static int ReadJPEG(const uint8_t* const data, size_t data_size,
   if (metadata != NULL) SaveMetadataMarkers((j_decompress_ptr)&dinfo);
   jpeg_read_header((j_decompress_ptr)&dinfo, TRUE);
 
+  if (resize_width > 0 || resize_height > 0) {
+    // the smallest power of two reduction still at least the target size
+    int w, h, denom = 8;
+    ResizeTarget(dinfo.image_width, dinfo.image_height, &w, &h);
+    while (denom > 1 &&
+           ((int)((dinfo.image_width + denom - 1) / denom) < w ||
+            (int)((dinfo.image_height + denom - 1) / denom) < h)) {
+      denom >>= 1;
+    }
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = denom;
+    target_w = w;
+    target_h = h;
+  }
+
+  if (IsJPEGYUV420((const struct jpeg_decompress_struct*)&dinfo)) {
+    // the strip goes in 'rgb', freed at End, also after a longjmp()
+    if (!ReadJPEGYUV420((j_decompress_ptr)&dinfo, pic, &rgb)) goto Error;
+    if (metadata != NULL &&
+        !ExtractMetadataFromJPEG((j_decompress_ptr)&dinfo, metadata)) {
+      fprintf(stderr, "Error extracting JPEG metadata!\n");
+      goto Error;
+    }
+    jpeg_finish_decompress((j_decompress_ptr)&dinfo);
+    jpeg_destroy_decompress((j_decompress_ptr)&dinfo);
+    ok = (target_w == 0 || PictureRescale(pic, target_w, target_h));
+    goto End;
+  }
+
   dinfo.out_color_space = JCS_RGB;
   dinfo.do_fancy_upsampling = TRUE;
 
@@ -2339,7 +2850,8 @@ static int ReadJPEG(const uint8_t* const data, size_t data_size,
   // WebP conversion.
   pic->width = width;
   pic->height = height;
-  ok = WebPPictureImportRGB(pic, rgb, (int)stride);
+  ok = WebPPictureImportRGB(pic, rgb, (int)stride) &&
+       (target_w == 0 || PictureRescale(pic, target_w, target_h));
   if (!ok) goto Error;
 
  End:
@@ -2530,6 +3042,108 @@ static int WebPPictureImportRGBA(WebPPicture* picture,
              : 0;
 }
 
+// Size in bytes of the 'tmp_rgb' scratch of ImportRGBARows().
+static size_t ImportRowsScratch(int width) {
+  const size_t uv_width = ((size_t)width + 1) >> 1;
+  return 4 * uv_width * sizeof(uint16_t) + 2 * (size_t)width + 2 * uv_width;
+}
+
+// Converts one or two rows of RGB(A) at row 'y' of the picture, the same
+// way ImportYUVAFromRGBA() does without dithering. 'a_ptr' is NULL or
+// requires step 4, 'tmp_rgb' holds ImportRowsScratch() bytes: for a tiled
+// picture the rows go through lines behind the 4 * uv_width accumulated
+// values. Returns true if the rows are not all opaque.
+static int ImportRGBARows(const uint8_t* const r_ptr,
+                          const uint8_t* const g_ptr,
+                          const uint8_t* const b_ptr,
+                          const uint8_t* const a_ptr,
+                          int step, int rgb_stride, int num_rows, int y,
+                          uint16_t* const tmp_rgb,
+                          WebPPicture* const picture) {
+  const int width = picture->width;
+  const int uv_width = (width + 1) >> 1;
+  const int tiled = (picture->tiles_ != NULL);
+  uint8_t* const line = (uint8_t*)(tmp_rgb + 4 * uv_width);
+  const int y_stride = tiled ? width : picture->y_stride;
+  uint8_t* const dst_y = tiled ? line : picture->y + y * y_stride;
+  uint8_t* const dst_u = tiled ? line + 2 * width
+                               : picture->u + (y >> 1) * picture->uv_stride;
+  uint8_t* const dst_v = tiled ? dst_u + uv_width
+                               : picture->v + (y >> 1) * picture->uv_stride;
+  int rows_have_alpha = 0;
+
+  if (num_rows == 1) rgb_stride = 0;
+  ConvertRowToY(r_ptr, g_ptr, b_ptr, step, dst_y, width, NULL);
+  if (num_rows == 2) {
+    ConvertRowToY(r_ptr + rgb_stride, g_ptr + rgb_stride, b_ptr + rgb_stride,
+                  step, dst_y + y_stride, width, NULL);
+  }
+  if (a_ptr != NULL) {
+    assert(step == 4);
+    rows_have_alpha = !ExtractAlpha_C(a_ptr, rgb_stride, width, num_rows,
+                                      picture->a + y * picture->a_stride,
+                                      picture->a_stride);
+  }
+  if (!rows_have_alpha) {
+    AccumulateRGB(r_ptr, g_ptr, b_ptr, step, rgb_stride, tmp_rgb, width);
+  } else {
+    AccumulateRGBA(r_ptr, g_ptr, b_ptr, a_ptr, rgb_stride, tmp_rgb, width);
+  }
+  computing_rgb_to_uv(tmp_rgb, dst_u, dst_v, uv_width);
+  if (tiled) {
+    TileRowY(picture, y, dst_y);
+    if (num_rows == 2) TileRowY(picture, y + 1, dst_y + y_stride);
+    TileRowUV(picture, y >> 1, dst_u, dst_v);
+  }
+  return rows_have_alpha;
+}
+
+// Allocates the planes for ImportRGBARows(), with an alpha plane if the
+// rows to come may have one, or the tiles of an opaque picture.
+static int ImportRowsStart(WebPPicture* const pic, int has_alpha) {
+  if (!has_alpha && pic->want_tiles_) return PictureAllocTiles(pic);
+  pic->use_argb = 0;
+  pic->colorspace = has_alpha ? WEBP_YUV420A : WEBP_YUV420;
+  return WebPPictureAllocYUVA(pic, pic->width, pic->height);
+}
+
+// Drops the alpha plane again if all rows turned out to be opaque, as
+// ImportYUVAFromRGBA() decides upfront with CheckNonOpaque().
+static void ImportRowsEnd(WebPPicture* const pic, int non_opaque) {
+  if (pic->tiles_ != NULL) TileFinish(pic);
+  if (pic->a != NULL && !non_opaque) {
+    pic->colorspace = WEBP_YUV420;
+    pic->a = NULL;
+    pic->a_stride = 0;
+  }
+}
+
+// Non-interlaced PNG: the rows are converted two at a time as libpng
+// delivers them, there is no full frame RGB(A) copy. Not for -sharp_yuv,
+// whose passes run over the whole frame.
+static int ReadPNGRows(png_structp png, int stride, int has_alpha,
+                       uint8_t* const rows, uint16_t* const tmp_rgb,
+                       WebPPicture* const pic) {
+  const int height = pic->height;
+  int non_opaque = 0;
+  int y;
+
+  if (!ImportRowsStart(pic, has_alpha)) return 0;
+  for (y = 0; y < height; y += 2) {
+    const int num_rows = (height - y >= 2) ? 2 : 1;
+    png_bytep row[2];
+    row[0] = rows;
+    row[1] = rows + stride;
+    png_read_rows(png, row, NULL, num_rows);
+    non_opaque |= ImportRGBARows(rows, rows + 1, rows + 2,
+                                 has_alpha ? rows + 3 : NULL,
+                                 has_alpha ? 4 : 3, stride, num_rows, y,
+                                 tmp_rgb, pic);
+  }
+  ImportRowsEnd(pic, non_opaque);
+  return 1;
+}
+
 static int ReadPNG(const uint8_t* const data, size_t data_size,
             struct WebPPicture* const pic,
             int keep_alpha, struct Metadata* const metadata) {
@@ -2542,6 +3156,7 @@ static int ReadPNG(const uint8_t* const data, size_t data_size,
   int num_passes;
   int p;
   volatile int ok = 0;
+  volatile int streamed = 0;
   png_uint_32 width, height, y;
   int64_t stride;
   uint8_t* volatile rgb = NULL;
@@ -2615,13 +3230,26 @@ static int ReadPNG(const uint8_t* const data, size_t data_size,
     goto Error;
   }
 
-  rgb = (uint8_t*)malloc((size_t)stride * height);
-  if (rgb == NULL) goto Error;
-  for (p = 0; p < num_passes; ++p) {
-    png_bytep row = rgb;
-    for (y = 0; y < height; ++y) {
-      png_read_rows(png, &row, NULL, 1);
-      row += stride;
+  pic->width = (int)width;
+  pic->height = (int)height;
+  if (num_passes == 1 && !pic->use_argb && !sharp_yuv) {
+    // two rows, then the scratch of ImportRGBARows()
+    rgb = (uint8_t*)malloc(2 * (size_t)stride + ImportRowsScratch(width));
+    if (rgb == NULL) goto Error;
+    if (!ReadPNGRows(png, (int)stride, has_alpha, rgb,
+                     (uint16_t*)(rgb + 2 * (size_t)stride), pic)) {
+      goto Error;
+    }
+    streamed = 1;
+  } else {
+    rgb = (uint8_t*)malloc((size_t)stride * height);
+    if (rgb == NULL) goto Error;
+    for (p = 0; p < num_passes; ++p) {
+      png_bytep row = rgb;
+      for (y = 0; y < height; ++y) {
+        png_read_rows(png, &row, NULL, 1);
+        row += stride;
+      }
     }
   }
   png_read_end(png, end_info);
@@ -2632,10 +3260,12 @@ static int ReadPNG(const uint8_t* const data, size_t data_size,
     goto Error;
   }
 
-  pic->width = (int)width;
-  pic->height = (int)height;
-  ok = has_alpha ? WebPPictureImportRGBA(pic, rgb, (int)stride)
-                 : WebPPictureImportRGB(pic, rgb, (int)stride);
+  if (streamed) {
+    ok = 1;
+  } else {
+    ok = has_alpha ? WebPPictureImportRGBA(pic, rgb, (int)stride)
+                   : WebPPictureImportRGB(pic, rgb, (int)stride);
+  }
 
   if (!ok) {
     goto Error;
@@ -2676,17 +3306,287 @@ static int ReadWebP(const uint8_t* const data, size_t data_size,
 	  return 0;
 }
 
-static int ReadPNM(const uint8_t* const data, size_t data_size,
-            WebPPicture* const pic, int keep_alpha,
-            struct Metadata* const metadata) {
-	  (void)data;
-	  (void)data_size;
-	  (void)pic;
-	  (void)keep_alpha;
-	  (void)metadata;
-	  fprintf(stderr, "PNM support not compiled. Please install the pnm "
-	          "development package before building.\n");
-	  return 0;
+typedef enum {
+  WIDTH_FLAG      = 1 << 0,
+  HEIGHT_FLAG     = 1 << 1,
+  DEPTH_FLAG      = 1 << 2,
+  MAXVAL_FLAG     = 1 << 3,
+  TUPLE_FLAG      = 1 << 4,
+  ALL_NEEDED_FLAGS = WIDTH_FLAG | HEIGHT_FLAG | DEPTH_FLAG | MAXVAL_FLAG
+} PNMFlags;
+
+typedef struct {
+  const uint8_t* data;
+  size_t data_size;
+  int width, height;
+  int bytes_per_px;   // 1, 2, 3 or 4, times 2 if max_value > 255
+  int depth;          // 1 (grayscale), 2 (grayscale + alpha), 3 or 4 (RGBA)
+  int max_value;
+  int type;           // 5, 6 or 7
+  int seen_flags;
+} PNMInfo;
+
+// Reads the next header line into 'out', skipping comments and blank
+// lines. Returns the offset after the line, or 0 at the end of the data.
+static size_t ReadPNMLine(const uint8_t* const data, size_t off,
+                          size_t data_size, char out[], size_t* const out_size) {
+  size_t i = 0;
+  *out_size = 0;
+ redo:
+  for (i = 0; i < 255 && off < data_size; ++i) {
+    out[i] = data[off++];
+    if (out[i] == '\n') break;
+  }
+  if (off < data_size) {
+    if (i == 0) goto redo;         // empty line
+    if (out[0] == '#') goto redo;  // skip comment
+  }
+  out[i] = 0;   // safety sentinel
+  *out_size = i;
+  return off;
+}
+
+static size_t FlagError(const char flag[]) {
+  fprintf(stderr, "PAM header error: flags '%s' already seen.\n", flag);
+  return 0;
+}
+
+// inspired from http://netpbm.sourceforge.net/doc/pam.html
+static size_t ReadPAMFields(PNMInfo* const info, size_t off) {
+  char out[256];
+  size_t out_size;
+  int tmp;
+  int expected_depth = -1;
+  assert(info != NULL);
+  while (1) {
+    off = ReadPNMLine(info->data, off, info->data_size, out, &out_size);
+    if (off == 0) return 0;
+    if (sscanf(out, "WIDTH %d", &tmp) == 1) {
+      if (info->seen_flags & WIDTH_FLAG) return FlagError("WIDTH");
+      info->seen_flags |= WIDTH_FLAG;
+      info->width = tmp;
+    } else if (sscanf(out, "HEIGHT %d", &tmp) == 1) {
+      if (info->seen_flags & HEIGHT_FLAG) return FlagError("HEIGHT");
+      info->seen_flags |= HEIGHT_FLAG;
+      info->height = tmp;
+    } else if (sscanf(out, "DEPTH %d", &tmp) == 1) {
+      if (info->seen_flags & DEPTH_FLAG) return FlagError("DEPTH");
+      info->seen_flags |= DEPTH_FLAG;
+      info->depth = tmp;
+    } else if (sscanf(out, "MAXVAL %d", &tmp) == 1) {
+      if (info->seen_flags & MAXVAL_FLAG) return FlagError("MAXVAL");
+      info->seen_flags |= MAXVAL_FLAG;
+      info->max_value = tmp;
+    } else if (!strcmp(out, "TUPLTYPE RGB_ALPHA")) {
+      expected_depth = 4;
+      info->seen_flags |= TUPLE_FLAG;
+    } else if (!strcmp(out, "TUPLTYPE RGB")) {
+      expected_depth = 3;
+      info->seen_flags |= TUPLE_FLAG;
+    } else if (!strcmp(out, "TUPLTYPE GRAYSCALE_ALPHA")) {
+      expected_depth = 2;
+      info->seen_flags |= TUPLE_FLAG;
+    } else if (!strcmp(out, "TUPLTYPE GRAYSCALE")) {
+      expected_depth = 1;
+      info->seen_flags |= TUPLE_FLAG;
+    } else if (!strcmp(out, "ENDHDR")) {
+      break;
+    } else {
+      static const char kEllipsis[] = " ...";
+      int i;
+      if (out_size > 20) sprintf(out + 20 - strlen(kEllipsis), kEllipsis);
+      for (i = 0; i < (int)strlen(out); ++i) {
+        // isprint() might trigger a "char-subscripts" warning if given a char.
+        if (!isprint((int)out[i])) out[i] = ' ';
+      }
+      fprintf(stderr, "PAM header error: unrecognized entry [%s]\n", out);
+      return 0;
+    }
+  }
+  if (!(info->seen_flags & ALL_NEEDED_FLAGS)) {
+    fprintf(stderr, "PAM header error: missing tags%s%s%s%s\n",
+            (info->seen_flags & WIDTH_FLAG) ? "" : " WIDTH",
+            (info->seen_flags & HEIGHT_FLAG) ? "" : " HEIGHT",
+            (info->seen_flags & DEPTH_FLAG) ? "" : " DEPTH",
+            (info->seen_flags & MAXVAL_FLAG) ? "" : " MAXVAL");
+    return 0;
+  }
+  if (expected_depth != -1 && info->depth != expected_depth) {
+    fprintf(stderr, "PAM header error: expected DEPTH %d but got DEPTH %d\n",
+            expected_depth, info->depth);
+    return 0;
+  }
+  return off;
+}
+
+// Reads a decimal header field of a P5/P6 file at 'off', after any white
+// space and comments. Returns the offset after it, or 0.
+static size_t ReadPNMNumber(const uint8_t* const data, size_t off,
+                            size_t data_size, int* const value) {
+  int v = 0, digits = 0;
+  while (off < data_size) {
+    if (data[off] == '#') {
+      while (off < data_size && data[off] != '\n') ++off;
+    } else if (isspace((int)data[off])) {
+      ++off;
+    } else {
+      break;
+    }
+  }
+  while (off < data_size && isdigit((int)data[off]) && digits < 9) {
+    v = v * 10 + (data[off++] - '0');
+    ++digits;
+  }
+  if (digits == 0) return 0;
+  *value = v;
+  return off;
+}
+
+// Parses a P5, P6 or P7 header. Returns the offset of the samples, or 0.
+static size_t ParsePNMHeader(PNMInfo* const info) {
+  const uint8_t* const data = info->data;
+  const size_t data_size = info->data_size;
+  size_t off = 2;
+  info->seen_flags = 0;
+  if (data_size < 3 || data[0] != 'P') return 0;
+  info->type = data[1] - '0';
+  if (info->type == 7) {
+    char out[256];
+    size_t out_size;
+    off = ReadPNMLine(data, 0, data_size, out, &out_size);   // "P7"
+    if (off != 0) off = ReadPAMFields(info, off);
+  } else if (info->type == 5 || info->type == 6) {
+    off = ReadPNMNumber(data, off, data_size, &info->width);
+    if (off != 0) off = ReadPNMNumber(data, off, data_size, &info->height);
+    if (off != 0) off = ReadPNMNumber(data, off, data_size, &info->max_value);
+    // a single white space separates the header from the samples
+    if (off != 0 && off < data_size && isspace((int)data[off])) {
+      ++off;
+    } else {
+      off = 0;
+    }
+    info->depth = (info->type == 5) ? 1 : 3;
+  } else {
+    return 0;
+  }
+  if (off == 0) return 0;
+  // perform some basic numerical validation
+  if (info->width <= 0 || info->height <= 0 ||
+      info->depth <= 0 || info->depth > 4 ||
+      info->max_value <= 0 || info->max_value >= 65536) {
+    return 0;
+  }
+  info->bytes_per_px = info->depth * (info->max_value > 255 ? 2 : 1);
+  return off;
+}
+
+// Expands one row of samples to 8 bit RGBA.
+static void PNMRowToRGBA(const PNMInfo* const info, const uint8_t* src,
+                         uint8_t* dst) {
+  const int max_value = info->max_value;
+  const int wide = (max_value > 255);
+  int x, c;
+  for (x = 0; x < info->width; ++x, dst += 4) {
+    uint8_t v[4];
+    for (c = 0; c < info->depth; ++c) {
+      int s = wide ? (src[0] << 8) | src[1] : src[0];
+      src += wide ? 2 : 1;
+      if (s > max_value) s = max_value;
+      v[c] = (max_value == 255) ? s : (s * 255 + (max_value >> 1)) / max_value;
+    }
+    if (info->depth <= 2) {
+      dst[0] = dst[1] = dst[2] = v[0];
+      dst[3] = (info->depth == 2) ? v[1] : 0xff;
+    } else {
+      dst[0] = v[0];
+      dst[1] = v[1];
+      dst[2] = v[2];
+      dst[3] = (info->depth == 4) ? v[3] : 0xff;
+    }
+  }
+}
+
+// Machine generated frames come as P5/P6/P7 with 8 bit samples: those are
+// converted straight from 'data', the mapped file, without any copy. Other
+// sample layouts are expanded two rows at a time, or to a full RGBA frame
+// for -sharp_yuv.
+static int ReadPNM(const uint8_t* const data, size_t data_size,
+            WebPPicture* const pic, int keep_alpha,
+            struct Metadata* const metadata) {
+  PNMInfo info;
+  size_t offset;
+  uint64_t stride, pixel_bytes;
+  int ok = 0;
+
+  (void)metadata;   // PNM has no metadata
+  if (data == NULL || data_size == 0 || pic == NULL) return 0;
+
+  info.data = data;
+  info.data_size = data_size;
+  offset = ParsePNMHeader(&info);
+  if (offset == 0) {
+    fprintf(stderr, "Error parsing PNM header.\n");
+    return 0;
+  }
+  stride = (uint64_t)info.bytes_per_px * info.width;
+  pixel_bytes = stride * info.height;
+  if (stride > INT_MAX ||
+      !ImgIoUtilCheckSizeArgumentsOverflow(stride, info.height)) {
+    return 0;
+  }
+  if (data_size < offset + pixel_bytes) {
+    fprintf(stderr, "Truncated PNM file (P%d).\n", info.type);
+    return 0;
+  }
+
+  pic->width = info.width;
+  pic->height = info.height;
+  if (info.max_value == 255 && info.depth != 2) {
+    const uint8_t* const in = data + offset;
+    if (info.depth == 1) {
+      ok = ImportYUVAFromRGBA(in, in, in, NULL, 1, (int)stride,
+                              0.f /* no dithering */, sharp_yuv, pic);
+    } else {
+      ok = Import(pic, in, (int)stride, info.depth, 0,
+                  keep_alpha && info.depth == 4);
+    }
+  } else if (sharp_yuv) {
+    const int has_alpha = keep_alpha && (info.depth == 2 || info.depth == 4);
+    const size_t row_size = 4 * (size_t)info.width;
+    uint8_t* const rgba = (uint8_t*)malloc(row_size * info.height);
+    int y;
+
+    if (rgba == NULL) return 0;
+    for (y = 0; y < info.height; ++y) {
+      PNMRowToRGBA(&info, data + offset + y * stride, rgba + y * row_size);
+    }
+    ok = Import(pic, rgba, (int)row_size, 4, 0, has_alpha);
+    free(rgba);
+  } else {
+    const int has_alpha = keep_alpha && (info.depth == 2 || info.depth == 4);
+    const size_t row_size = 4 * (size_t)info.width;
+    uint8_t* const rows =
+        (uint8_t*)malloc(2 * row_size + ImportRowsScratch(info.width));
+    uint16_t* const tmp_rgb = (uint16_t*)(rows + 2 * row_size);
+    const uint8_t* in = data + offset;
+    int non_opaque = 0;
+    int y;
+
+    if (rows == NULL) return 0;
+    ok = ImportRowsStart(pic, has_alpha);
+    for (y = 0; ok && y < info.height; y += 2) {
+      const int num_rows = (info.height - y >= 2) ? 2 : 1;
+      PNMRowToRGBA(&info, in, rows);
+      if (num_rows == 2) PNMRowToRGBA(&info, in + stride, rows + row_size);
+      in += num_rows * stride;
+      non_opaque |= ImportRGBARows(rows, rows + 1, rows + 2,
+                                   has_alpha ? rows + 3 : NULL, 4,
+                                   (int)row_size, num_rows, y, tmp_rgb, pic);
+    }
+    if (ok) ImportRowsEnd(pic, non_opaque);
+    free(rows);
+  }
+  return ok;
 }
 
 static int FailReader(const uint8_t* const data, size_t data_size,
@@ -2915,33 +3815,100 @@ static int WebPPictureYUVAToARGB(WebPPicture* picture) {
   return 1;
 }
 
+// Raw 4:2:0 frames (-yuv): no header, the size comes from -yuv_size or
+// from a "<input>.size" file next to the input holding "<w> <h>".
+static RawYUVFormat raw_yuv = RAW_YUV_NONE;
+static int raw_width = 0;
+static int raw_height = 0;
+
+// Splits the interleaved U/V rows of NV12 into the U and V planes.
+static void SplitUVPlane(const uint8_t* src, int src_stride,
+                         uint8_t* dst_u, uint8_t* dst_v, int dst_stride,
+                         int width, int height) {
+  int x;
+  while (height-- > 0) {
+    for (x = 0; x < width; ++x) {
+      dst_u[x] = src[2 * x + 0];
+      dst_v[x] = src[2 * x + 1];
+    }
+    src += src_stride;
+    dst_u += dst_stride;
+    dst_v += dst_stride;
+  }
+}
+
+// I420 (Y, U, V planes) or NV12 (Y plane, interleaved U/V). With
+// 'in_place' the picture points into 'data' instead of holding a copy,
+// for NV12 only the chroma is copied. 'data' then has to stay mapped
+// until the macroblocks are packed, after which the planes are not read.
 static int ReadYUV(const uint8_t* const data, size_t data_size,
-                   WebPPicture* const pic) {
+                   WebPPicture* const pic, int in_place) {
   const int use_argb = pic->use_argb;
+  const int nv12 = (raw_yuv == RAW_YUV_NV12);
   const int uv_width = (pic->width + 1) / 2;
   const int uv_height = (pic->height + 1) / 2;
-  const int y_plane_size = pic->width * pic->height;
-  const int uv_plane_size = uv_width * uv_height;
-  const size_t expected_data_size = y_plane_size + 2 * uv_plane_size;
+  const uint64_t y_plane_size = (uint64_t)pic->width * pic->height;
+  const uint64_t uv_plane_size = (uint64_t)uv_width * uv_height;
+  const uint64_t expected_data_size = y_plane_size + 2 * uv_plane_size;
+  const uint8_t* const uv = data + y_plane_size;
 
   if (data_size != expected_data_size) {
     fprintf(stderr,
-            "input data doesn't have the expected size (%d instead of %d)\n",
-            (int)data_size, (int)expected_data_size);
+            "input data doesn't have the expected size (%lu instead of %lu)\n",
+            (unsigned long)data_size, (unsigned long)expected_data_size);
     return 0;
   }
 
   pic->use_argb = 0;
-  if (!WebPPictureAlloc(pic)) return 0;
-  ImgIoUtilCopyPlane(data, pic->width, pic->y, pic->y_stride,
-                     pic->width, pic->height);
-  ImgIoUtilCopyPlane(data + y_plane_size, uv_width,
-                     pic->u, pic->uv_stride, uv_width, uv_height);
-  ImgIoUtilCopyPlane(data + y_plane_size + uv_plane_size, uv_width,
-                     pic->v, pic->uv_stride, uv_width, uv_height);
+  if (in_place && !use_argb) {
+    WebPPictureFree(pic);
+    pic->colorspace = WEBP_YUV420;
+    pic->y = (uint8_t*)data;
+    pic->y_stride = pic->width;
+    pic->uv_stride = uv_width;
+    if (!nv12) {
+      pic->u = (uint8_t*)uv;
+      pic->v = (uint8_t*)uv + uv_plane_size;
+      return 1;
+    }
+    pic->memory_ = WebPSafeMalloc(2 * uv_plane_size, sizeof(uint8_t));
+    if (pic->memory_ == NULL) {
+      return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    }
+    pic->u = (uint8_t*)pic->memory_;
+    pic->v = pic->u + uv_plane_size;
+  } else {
+    if (!WebPPictureAlloc(pic)) return 0;
+    ImgIoUtilCopyPlane(data, pic->width, pic->y, pic->y_stride,
+                       pic->width, pic->height);
+    if (!nv12) {
+      ImgIoUtilCopyPlane(uv, uv_width,
+                         pic->u, pic->uv_stride, uv_width, uv_height);
+      ImgIoUtilCopyPlane(uv + uv_plane_size, uv_width,
+                         pic->v, pic->uv_stride, uv_width, uv_height);
+      return use_argb ? WebPPictureYUVAToARGB(pic) : 1;
+    }
+  }
+  SplitUVPlane(uv, 2 * uv_width, pic->u, pic->v, pic->uv_stride,
+               uv_width, uv_height);
   return use_argb ? WebPPictureYUVAToARGB(pic) : 1;
 }
 
+// Decodes an input already in memory. The readers only look at 'data', so
+// it can be a read-only mapping of the file; with 'in_place' a raw YUV
+// picture may even point into it, see ReadYUV().
+static int ReadPictureData(const uint8_t* const data, size_t data_size,
+                           WebPPicture* const pic, int keep_alpha,
+                           Metadata* const metadata, int in_place) {
+  if (pic->width == 0 || pic->height == 0) {
+    WebPImageReader reader = WebPGuessImageReader(data, data_size);
+    return reader(data, data_size, pic, keep_alpha, metadata) &&
+           PictureResize(pic);
+  }
+  // If image size is specified, infer it as YUV format.
+  return ReadYUV(data, data_size, pic, in_place) && PictureResize(pic);
+}
+
 static int ReadPicture(const char* const filename, WebPPicture* const pic,
                        int keep_alpha, Metadata* const metadata) {
   const uint8_t* data = NULL;
@@ -2951,13 +3918,7 @@ static int ReadPicture(const char* const filename, WebPPicture* const pic,
   ok = ImgIoUtilReadFile(filename, &data, &data_size);
   if (!ok) goto End;
 
-  if (pic->width == 0 || pic->height == 0) {
-    WebPImageReader reader = WebPGuessImageReader(data, data_size);
-    ok = reader(data, data_size, pic, keep_alpha, metadata);
-  } else {
-    // If image size is specified, infer it as YUV format.
-    ok = ReadYUV(data, data_size, pic);
-  }
+  ok = ReadPictureData(data, data_size, pic, keep_alpha, metadata, 0);
  End:
   if (!ok) {
     fprintf(stderr, "Error! Could not process file %s\n", filename);
@@ -2966,10 +3927,59 @@ static int ReadPicture(const char* const filename, WebPPicture* const pic,
   return ok;
 }
 
+// Writer of the files of the output stage (computing_writer.h). The
+// encoder hands its partitions over with PutBitWriter() instead.
 static int MyWriter(const uint8_t* data, size_t data_size,
                     const WebPPicture* const pic) {
-  FILE* const out = (FILE*)pic->custom_ptr;
-  return data_size ? (fwrite(data, data_size, 1, out) == 1) : 1;
+  struct computing_out* const out = (struct computing_out*)pic->custom_ptr;
+  return computing_out_copy(out, data, data_size) == 0;
+}
+
+static void WebPMemoryWriterInit(WebPMemoryWriter* writer) {
+  writer->mem = NULL;
+  writer->size = 0;
+  writer->max_size = 0;
+}
+
+static int WebPMemoryWrite(const uint8_t* data, size_t data_size,
+                           const WebPPicture* picture) {
+  WebPMemoryWriter* const w = (WebPMemoryWriter*)picture->custom_ptr;
+  uint64_t next_size;
+  if (w == NULL) {
+    return 1;
+  }
+  next_size = (uint64_t)w->size + data_size;
+  if (next_size > w->max_size) {
+    uint8_t* new_mem;
+    uint64_t next_max_size = 2ULL * w->max_size;
+    if (next_max_size < next_size) next_max_size = next_size;
+    if (next_max_size < 8192ULL) next_max_size = 8192ULL;
+    new_mem = (uint8_t*)WebPSafeMalloc(next_max_size, 1);
+    if (new_mem == NULL) {
+      return 0;
+    }
+    if (w->size > 0) {
+      memcpy(new_mem, w->mem, w->size);
+    }
+    WebPSafeFree(w->mem);
+    w->mem = new_mem;
+    // down-cast is ok, thanks to WebPSafeMalloc
+    w->max_size = (size_t)next_max_size;
+  }
+  if (data_size > 0) {
+    memcpy(w->mem + w->size, data, data_size);
+    w->size += data_size;
+  }
+  return 1;
+}
+
+static void WebPMemoryWriterClear(WebPMemoryWriter* writer) {
+  if (writer != NULL) {
+    WebPSafeFree(writer->mem);
+    writer->mem = NULL;
+    writer->size = 0;
+    writer->max_size = 0;
+  }
 }
 
 static const char* const kErrorMessages[VP8_ENC_ERROR_LAST] = {
@@ -11973,10 +12983,63 @@ static void ImportLine(const uint8_t* src, int src_stride,
   for (; i < total_len; ++i) dst[i] = dst[len - 1];
 }
 
+// VP8IteratorImport() of a picture in macroblock tiles. The edges are
+// already replicated into the tiles, every row is 16 samples.
+static void VP8IteratorImportTiles(VP8EncIterator* const it,
+                                   uint8_t* tmp_32) {
+  const VP8Encoder* const enc = it->enc_;
+  const int x = it->x_, y = it->y_;
+  const size_t mb_w = enc->mb_w_;
+  const uint8_t* const tile = enc->pic_->tiles_ + 128 + (y * mb_w + x) * 384;
+  int i;
+
+  for (i = 0; i < 16; ++i) {
+    memcpy(it->yuv_in_ + Y_OFF_ENC + i * BPS, tile + i * 16, 16);
+  }
+  for (i = 0; i < 8; ++i) {
+    memcpy(it->yuv_in_ + U_OFF_ENC + i * BPS, tile + 256 + i * 16, 8);
+    memcpy(it->yuv_in_ + V_OFF_ENC + i * BPS, tile + 264 + i * 16, 8);
+  }
+
+  if (tmp_32 == NULL) return;
+
+  if (x == 0) {
+    InitLeft(it);
+  } else {
+    const uint8_t* const left = tile - 384;
+    if (y == 0) {
+      it->y_left_[-1] = it->u_left_[-1] = it->v_left_[-1] = 127;
+    } else {
+      const uint8_t* const top_left = left - mb_w * 384;
+      it->y_left_[-1] = top_left[15 * 16 + 15];
+      it->u_left_[-1] = top_left[256 + 7 * 16 + 7];
+      it->v_left_[-1] = top_left[264 + 7 * 16 + 7];
+    }
+    ImportLine(left + 15,  16, it->y_left_, 16, 16);
+    ImportLine(left + 263, 16, it->u_left_, 8, 8);
+    ImportLine(left + 271, 16, it->v_left_, 8, 8);
+  }
+
+  it->y_top_  = tmp_32 + 0;
+  it->uv_top_ = tmp_32 + 16;
+  if (y == 0) {
+    memset(tmp_32, 127, 32 * sizeof(*tmp_32));
+  } else {
+    const uint8_t* const top = tile - mb_w * 384;
+    memcpy(tmp_32, top + 15 * 16, 16);
+    memcpy(tmp_32 + 16, top + 256 + 7 * 16, 8);
+    memcpy(tmp_32 + 16 + 8, top + 264 + 7 * 16, 8);
+  }
+}
+
 static void VP8IteratorImport(VP8EncIterator* const it, uint8_t* tmp_32) {
   const VP8Encoder* const enc = it->enc_;
   const int x = it->x_, y = it->y_;
   const WebPPicture* const pic = enc->pic_;
+  if (pic->tiles_ != NULL) {
+    VP8IteratorImportTiles(it, tmp_32);
+    return;
+  }
   const uint8_t* const ysrc = pic->y + (y * pic->y_stride  + x) * 16;
   const uint8_t* const usrc = pic->u + (y * pic->uv_stride + x) * 8;
   const uint8_t* const vsrc = pic->v + (y * pic->uv_stride + x) * 8;
@@ -15161,6 +16224,24 @@ static int PutWebPHeaders(const VP8Encoder* const enc, size_t size0,
 
 #define VP8_MAX_PARTITION_SIZE  (1 << 24)   // max size for token partition
 
+// Writes the buffer of 'bw' and frees it. For an output of the writer
+// stage the buffer itself goes into the output, without a copy.
+static int PutBitWriter(const WebPPicture* const pic, VP8BitWriter* const bw) {
+  uint8_t* const buf = VP8BitWriterBuf(bw);
+  const size_t size = VP8BitWriterSize(bw);
+  int ok = 1;
+
+  if (pic->writer == MyWriter && buf != NULL) {
+    ok = (computing_out_take((struct computing_out*)pic->custom_ptr, buf, size,
+                             WebPSafeFree) == 0);
+    bw->buf_ = NULL;
+  } else if (size) {
+    ok = pic->writer(buf, size, pic);
+  }
+  VP8BitWriterWipeOut(bw);    // will free the internal buffer.
+  return ok;
+}
+
 // Partition sizes
 static int EmitPartitionsSize(const VP8Encoder* const enc,
                               WebPPicture* const pic) {
@@ -15220,19 +16301,16 @@ static int VP8EncWrite(VP8Encoder* const enc) {
 
   // Emit headers and partition #0
   {
-    const uint8_t* const part0 = VP8BitWriterBuf(bw);
     const size_t size0 = VP8BitWriterSize(bw);
     ok = ok && PutWebPHeaders(enc, size0, vp8_size, riff_size)
-            && pic->writer(part0, size0, pic)
+            && PutBitWriter(pic, bw)
             && EmitPartitionsSize(enc, pic);
     VP8BitWriterWipeOut(bw);    // will free the internal buffer.
   }
 
   // Token partitions
   for (p = 0; p < enc->num_parts_; ++p) {
-    const uint8_t* const buf = VP8BitWriterBuf(enc->parts_ + p);
-    const size_t size = VP8BitWriterSize(enc->parts_ + p);
-    if (size) ok = ok && pic->writer(buf, size, pic);
+    ok = ok && PutBitWriter(pic, enc->parts_ + p);
     VP8BitWriterWipeOut(enc->parts_ + p);    // will free the internal buffer.
     ok = ok && WebPReportProgress(pic, enc->percent_ + percent_per_part,
                                   &enc->percent_);
@@ -15308,136 +16386,675 @@ static int DeleteVP8Encoder(VP8Encoder* enc) {
   return ok;
 }
 
-#define BUFFER_LEN 256
-VP8Encoder* enc_g[BUFFER_LEN];
-VP8EncIterator* it_g[BUFFER_LEN];
-WebPPicture* picture_g[BUFFER_LEN];
-uint8_t* mem_out_g[BUFFER_LEN];
-uint8_t* mem_in_g[BUFFER_LEN];
+// A caller of the library API (computing_encode.h) waiting for its picture.
+typedef struct EncodeWait {
+  WebPMemoryWriter memory;    // the WebP file
+  int done;
+  int ok;
+} EncodeWait;
+
+// One picture on its way through the pipeline. The front end fills it,
+// the FPGA stage runs the action on it and WebPEncode() writes it out.
+typedef struct EncodeJob {
+  VP8Encoder* enc;
+  VP8EncIterator* it;
+  WebPPicture* picture;
+  uint8_t* mem_in;
+  uint8_t* mem_out;
+  size_t bytes;               // memory held, counted against mem_budget
+  uint32_t seq;               // input order
+  struct computing_out* out;  // -ordered: held until its turn
+  EncodeWait* wait;           // library call, instead of 'out'
+  int ok;
+  WebPAuxStats stats;
+  struct EncodeJob* next;     // -ordered: waiting for an earlier job
+} EncodeJob;
+
+static int card_no = -1;
+static uint32_t timeout = 60;
+static snap_action_flag_t attach_flags = 0;
+
+// One entry per card/AFU. Jobs are submitted asynchronously: a device runs
+// the job at the head of its queue and keeps up to fpga_depth - 1 more
+// queued behind it, so the next job starts as soon as the card is done.
+// A single reaper thread (FPGAEncode) collects completions for all cards.
+#define MAX_FPGA_DEVICES 16
+#define MAX_FPGA_DEPTH 64
+
+// HLS control register (AP_CTRL) of the action
+#ifndef ACTION_CONTROL
+#define ACTION_CONTROL      0x00
+#define ACTION_CONTROL_IDLE 0x04
+#endif
 
-int card_no = 0;
-uint32_t timeout = 60;
-snap_action_flag_t attach_flags = 0;
-sem_t binSem;
-sem_t FPGASem;
+typedef struct {
+  uint32_t ticket;
+  EncodeJob* ejob;
+  int mbs;                    // macroblocks of the picture
+  int started;
+  struct snap_job cjob;
+  struct computing_job mjob;
+  struct timeval start;
+} FPGAJob;
 
-char device[64];
-struct snap_card *card = NULL;
-struct snap_action *action = NULL;
+typedef struct {
+  char device[64];
+  struct snap_card *card;
+  struct snap_action *action;
+  FPGAJob job[MAX_FPGA_DEPTH];  // job[head] is the one on the card
+  int head, count;
+  uint64_t queued_mbs;        // macroblocks queued or running on the card
+  double usec_per_mb;         // running estimate of the card throughput
+  uint32_t done;              // images completed by this device
+} FPGADevice;
 
-uint32_t total_pic = 0;
-uint32_t fpga_pic = 0;
-uint32_t WebP_pic = 0;
+typedef struct {
+  uint32_t ticket;
+  EncodeJob* job;
+  int ok;
+  FPGADevice* dev;
+} FPGACompletion;
+
+static FPGADevice fpga_dev[MAX_FPGA_DEVICES];
+static int fpga_dev_num = 0;
+static int fpga_depth = 4;           // jobs per device, the running one included
+static int fpga_spin_us = 200;       // busy-poll window before sleeping on a card
+static uint32_t fpga_ticket = 0;
+static int fpga_closing = 0;
+static pthread_t fpga_thread[MAX_FPGA_DEVICES];  // FPGAEncode(), one per device
+static int fpga_thread_num = 0;
+static pthread_mutex_t fpga_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fpga_cond = PTHREAD_COND_INITIALIZER;
+
+// With -cpu, host threads run the same kernel as the card
+// (computing_cpu_run()) on the pictures the cards would only make wait:
+// a picture goes to whichever backend is expected to finish it first,
+// from the measured usec/MB of each. The output does not depend on where
+// a picture was encoded. The counters are under fpga_lock.
+#define MAX_CPU_THREADS 64
+static int cpu_threads = 0;
+static int cpu_rows = 1;             // threads on the rows of one picture
+static int cpu_count = 0;            // jobs queued or running on the cpu threads
+static uint64_t cpu_queued_mbs = 0;
+static double cpu_usec_per_mb = 0.;  // running estimate of one thread
+static uint32_t cpu_done = 0;
+static struct computing_queue* cpu_queue = NULL;
+static pthread_t cpu_thread[MAX_CPU_THREADS];
+
+// Jobs finished by any device, in completion order, for WebPEncode().
+// When it is full the reaper stops, the cards fill up and the front end
+// blocks in EncodeJobSubmit().
+static struct computing_queue* done_queue = NULL;
+static int done_depth = 16;
+
+// The encoder stage runs on emit_threads workers taking jobs from
+// done_queue. Outputs are written in completion order, or in input order
+// with -ordered.
+#define MAX_EMIT_THREADS 64
+static int emit_threads = 4;
+static int ordered = 0;
+static uint32_t write_seq = 0;       // next job to be written
+static EncodeJob* reorder_list = NULL;
+static pthread_mutex_t order_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Library calls sleep here until EncodeJobFinish() sets their 'done'.
+static pthread_mutex_t wait_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER;
+static int report_jobs = 1;          // SUCCESS/FAILED per picture on stdout
+
+// main() lists the input directory into file_queue; front_threads workers
+// decode, analyze and pack the pictures and submit them to the cards.
+// Every queued file is already mapped with MADV_WILLNEED, so up to
+// front_prefetch inputs are read by the kernel ahead of the decoders.
+#define MAX_FRONT_THREADS 64
+#define MAX_FRONT_PATH 1024
+typedef struct {
+  char in[MAX_FRONT_PATH];
+  char out[MAX_FRONT_PATH];
+  const uint8_t* data;        // mapping of 'in', NULL if it could not be mapped
+  size_t size;
+  uint32_t seq;               // position in the input listing
+} FrontEndFile;
 
+typedef struct {
+  const WebPConfig* config;
+  int keep_alpha;
+} FrontEndArgs;
 
-struct timeval endtime, starttime;
+static struct computing_queue* file_queue = NULL;
+static int front_failed = 0;
 
-static void *FPGAEncode(void *tid) {
-		
-  int buffer_cnt = 0;
- 
-  // Allocate the card that will be used
-  if(card_no == 0)
-	snprintf(device, sizeof(device)-1, "IBM,oc-snap");
-  else
-	snprintf(device, sizeof(device)-1, "/dev/ocxl/IBM,oc-snap.000%d:00:00.1.0", card_no);
-  
-  card = snap_card_alloc_dev (device, SNAP_VENDOR_ID_IBM, SNAP_DEVICE_ID_SNAP);  
-  if (card == NULL) {
-	  fprintf(stderr, "ERROR: snap_card_alloc_dev(%s)\n", device);
-	  return tid;
+// -rendition: every input is encoded once per rendition from a single
+// decode, see FrontEndRenditions(). Rendition i of the input at position
+// seq takes position seq + i in the output order.
+#define MAX_RENDITIONS 8
+typedef struct {
+  int width, height;      // 0 in one dimension keeps the aspect ratio
+  float quality;
+  char tag[48];           // "-<w>x<h>-q<quality>", added to the output name
+} Rendition;
+static Rendition renditions[MAX_RENDITIONS];
+static WebPConfig rendition_config[MAX_RENDITIONS];
+static int num_renditions = 0;
+
+// -cache: the outputs of an input whose bytes and settings were seen
+// before come from computing_cache.h, see FrontEndFromCache().
+#define CACHE_VERSION 1   // of the encoder output, part of every key
+static int result_cache = 0;
+
+// main() does not read the next picture while the jobs in flight hold
+// more than mem_budget bytes.
+static size_t mem_budget = (size_t)1 << 30;
+static size_t inflight_bytes = 0;
+static int inflight_jobs = 0;
+static pthread_mutex_t budget_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t budget_cond = PTHREAD_COND_INITIALIZER;
+
+static int CompareDeviceNames(const void* a, const void* b) {
+  return strcmp((const char*)a, (const char*)b);
+}
+
+static int FPGADeviceOpen(const char* name) {
+  FPGADevice* const dev = &fpga_dev[fpga_dev_num];
+
+  memset(dev, 0, sizeof(*dev));
+  snprintf(dev->device, sizeof(dev->device), "%s", name);
+  dev->card = snap_card_alloc_dev(dev->device, SNAP_VENDOR_ID_IBM,
+                                  SNAP_DEVICE_ID_SNAP);
+  if (dev->card == NULL) {
+    fprintf(stderr, "ERROR: snap_card_alloc_dev(%s)\n", dev->device);
+    return 0;
   }
-  
+
   // Attach the action that will be used on the allocated card
-  action = snap_attach_action(card, ACTION_TYPE_HDL_COMPUTING, attach_flags, timeout);
-  if (action == NULL) {
-	  fprintf(stderr, "Error: Can not attach Action: %x\n", ACTION_TYPE_HDL_COMPUTING);
-	  return tid;
+  dev->action = snap_attach_action(dev->card, ACTION_TYPE_HDL_COMPUTING,
+                                   attach_flags, timeout);
+  if (dev->action == NULL) {
+    fprintf(stderr, "Error: Can not attach Action: %x on %s\n",
+            ACTION_TYPE_HDL_COMPUTING, dev->device);
+    snap_card_free(dev->card);
+    dev->card = NULL;
+    return 0;
   }
-  
-  while(1){
-	sem_wait(&FPGASem);
-
-	VP8Encoder* enc = enc_g[buffer_cnt];
-	VP8EncIterator* it = it_g[buffer_cnt];
-	WebPPicture* picture = picture_g[buffer_cnt];
-	uint8_t* mem_in = mem_in_g[buffer_cnt];
-	uint8_t* mem_out = mem_out_g[buffer_cnt];
-	FILE *out = enc->pic_->custom_ptr;
-	int mb_w_ = enc->mb_w_;
-	int mb_h_ = enc->mb_h_; 
-	
-	struct snap_job cjob;
-	struct computing_job mjob;
-	
-	snap_prepare_computing(&cjob, &mjob, mem_in, mem_out, (mb_w_ | (mb_h_ << 16)));
-	
-	// Call the action will:
-	//	  write all the registers to the action (MMIO) 
-	//	+ start the action 
-	//	+ wait for completion
-	//	+ read all the registers from the action (MMIO) 
-	int rc = 0;	
-	rc = snap_action_sync_execute_job(action, &cjob, timeout);
-	
-	if (rc != 0) {
-		fprintf(stderr, "err: job execution %d: %s!\n", rc,
-			strerror(errno));
-		WebPPictureFree(picture);
-		WebPSafeFree(picture);
-		DeleteVP8Encoder(enc);
-		WebPSafeFree(it);
-		__free(mem_out); 
-        __free(mem_in);
-		fclose(out);
-		return tid;
-	}
-	
+
+  fpga_dev_num++;
+  return 1;
+}
+
+// With -C only the given card is used, otherwise every OpenCAPI SNAP AFU
+// found under /dev/ocxl that accepts the computing action.
+static int FPGADeviceDiscover(void) {
+  char names[MAX_FPGA_DEVICES][64];
+  char device[64];
+  int num = 0;
+  int i;
+
+  if (card_no >= 0) {
+    if (card_no == 0)
+      snprintf(device, sizeof(device)-1, "IBM,oc-snap");
+    else
+      snprintf(device, sizeof(device)-1, "/dev/ocxl/IBM,oc-snap.000%d:00:00.1.0", card_no);
+    return FPGADeviceOpen(device);
+  }
+
+  DIR* dir = opendir("/dev/ocxl");
+  if (dir != NULL) {
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL && num < MAX_FPGA_DEVICES) {
+      int len;
+      if (strncmp(entry->d_name, "IBM,oc-snap", 11)) continue;
+      // Skip names longer than FPGADevice.device can hold
+      len = snprintf(names[num], sizeof(names[0]), "/dev/ocxl/%s",
+                     entry->d_name);
+      if (len < 0 || len >= (int)sizeof(names[0])) continue;
+      num++;
+    }
+    closedir(dir);
+  }
+  qsort(names, num, sizeof(names[0]), CompareDeviceNames);
+
+  for (i = 0; i < num; ++i) {
+    FPGADeviceOpen(names[i]);
+  }
+  // No device node visible (e.g. simulation): fall back to the default AFU.
+  if (num == 0) FPGADeviceOpen("IBM,oc-snap");
+  return fpga_dev_num;
+}
+
+// The action stays attached for the whole run. After a failed job it is
+// detached and attached again, so one bad job does not stop the device.
+static void FPGADeviceReattach(FPGADevice* const dev) {
+  if (dev->action != NULL) snap_detach_action(dev->action);
+  dev->action = snap_attach_action(dev->card, ACTION_TYPE_HDL_COMPUTING,
+                                   attach_flags, timeout);
+  if (dev->action == NULL) {
+    fprintf(stderr, "Error: Can not attach Action: %x on %s\n",
+            ACTION_TYPE_HDL_COMPUTING, dev->device);
+  }
+}
+
+static void FPGADeviceClose(void) {
+  int i;
+
+  pthread_mutex_lock(&fpga_lock);
+  fpga_closing = 1;
+  pthread_cond_broadcast(&fpga_cond);
+  pthread_mutex_unlock(&fpga_lock);
+  for (i = 0; i < fpga_thread_num; ++i) {
+    pthread_join(fpga_thread[i], NULL);
+  }
+  fpga_thread_num = 0;
+
+  for (i = 0; i < fpga_dev_num; ++i) {
+    FPGADevice* const dev = &fpga_dev[i];
+    if (verbose) {
+      fprintf(stderr, "%s: %u pictures, %.2f usec/MB\n", dev->device,
+              dev->done, dev->usec_per_mb);
+    }
+    if (dev->action != NULL) snap_detach_action(dev->action);
+    snap_card_free(dev->card);
+  }
+  fpga_dev_num = 0;
+}
+
+// Writes the job registers and starts the action. Called with fpga_lock
+// held, only on a device that has nothing running.
+static void FPGAJobStart(FPGADevice* const dev, FPGAJob* const job) {
+  gettimeofday(&job->start, NULL);
+  if (dev->action == NULL) FPGADeviceReattach(dev);
+  if (dev->action == NULL) return;
+  if (snap_action_sync_execute_job_set_regs(dev->action, &job->cjob) != 0 ||
+      snap_action_start(dev->action) != 0) {
+    fprintf(stderr, "err: %s cannot start job %u: %s!\n", dev->device,
+            job->ticket, strerror(errno));
+    return;
+  }
+  job->started = 1;
+}
+
+// Expected usec until a picture of 'mbs' macroblocks queued now is done.
+// An estimate of 0 means nothing was measured yet.
+static double FPGADeviceEta(const FPGADevice* const dev, int mbs) {
+  return dev->usec_per_mb * (double)(dev->queued_mbs + mbs);
+}
+
+static double CPUEta(int mbs) {
+  return cpu_usec_per_mb * ((double)cpu_queued_mbs / cpu_threads + mbs);
+}
+
+// Queues the picture on the card expected to finish it first, or on the
+// cpu threads when they would be sooner. Blocks while every card holds
+// fpga_depth jobs and the cpu threads have one queued per thread.
+static void EncodeJobSubmit(EncodeJob* const ejob, int mbs) {
+  const VP8Encoder* const enc = ejob->enc;
+  FPGADevice* best;
+  FPGAJob* job;
+  int cpu = 0;
+  int i;
+
+  pthread_mutex_lock(&fpga_lock);
+  while (1) {
+    best = NULL;
+    for (i = 0; i < fpga_dev_num; ++i) {
+      FPGADevice* const dev = &fpga_dev[i];
+      if (dev->count >= fpga_depth) continue;
+      if (best == NULL ||
+          FPGADeviceEta(dev, mbs) < FPGADeviceEta(best, mbs) ||
+          (FPGADeviceEta(dev, mbs) == FPGADeviceEta(best, mbs) &&
+           dev->queued_mbs < best->queued_mbs)) {
+        best = dev;
+      }
+    }
+    if (cpu_threads > 0 && cpu_count < 2 * cpu_threads &&
+        (best == NULL || CPUEta(mbs) < FPGADeviceEta(best, mbs))) {
+      cpu = 1;
+      break;
+    }
+    if (best != NULL) break;
+    pthread_cond_wait(&fpga_cond, &fpga_lock);
+  }
+
+  if (cpu) {
+    cpu_count++;
+    cpu_queued_mbs += mbs;
+    pthread_mutex_unlock(&fpga_lock);
+    computing_queue_push(cpu_queue, ejob);
+    return;
+  }
+
+  job = &best->job[(best->head + best->count) % MAX_FPGA_DEPTH];
+  job->ticket = fpga_ticket++;
+  job->ejob = ejob;
+  job->mbs = mbs;
+  job->started = 0;
+  snap_prepare_computing(&job->cjob, &job->mjob, ejob->mem_in,
+                         ejob->mem_out, (enc->mb_w_ | (enc->mb_h_ << 16)));
+  best->queued_mbs += mbs;
+  if (best->count++ == 0) FPGAJobStart(best, job);
+
+  pthread_cond_broadcast(&fpga_cond);
+  pthread_mutex_unlock(&fpga_lock);
+}
+
+static int FPGAJobIdle(const FPGADevice* const dev) {
+  uint32_t ctrl = 0;
+  // A failing read is reported by the completion check
+  if (snap_mmio_read32(dev->card, ACTION_CONTROL, &ctrl) != 0) return 1;
+  return (ctrl & ACTION_CONTROL_IDLE) != 0;
+}
+
+// Waits until the running job of 'dev' is finished, starts the next queued
+// job on it and returns the finished one in 'c'. Returns 0 once the
+// devices are closed and nothing is left in flight on 'dev'.
+//
+// Every device has its own waiter thread, so whichever card finishes first
+// is served first. Completion is adaptive: when the job is expected to
+// finish within fpga_spin_us its idle bit is busy-polled for that long,
+// otherwise (or once the spin is over) the thread sleeps in the completion
+// check, on the card's interrupt with -I.
+static int FPGAJobWait(FPGADevice* const dev, FPGACompletion* const c) {
+  struct timeval now, spin_start;
+  FPGAJob* job;
+  double left;
+
+  pthread_mutex_lock(&fpga_lock);
+  while (dev->count == 0 && !fpga_closing) {
+    pthread_cond_wait(&fpga_cond, &fpga_lock);
+  }
+  if (dev->count == 0) {
+    pthread_mutex_unlock(&fpga_lock);
+    return 0;
+  }
+  job = &dev->job[dev->head];
+  gettimeofday(&now, NULL);
+  left = dev->usec_per_mb * job->mbs -
+         (double)timediff_usec(&now, &job->start);
+  pthread_mutex_unlock(&fpga_lock);
+
+  if (job->started && left <= fpga_spin_us) {
+    spin_start = now;
+    while (!FPGAJobIdle(dev) &&
+           (double)timediff_usec(&now, &spin_start) < fpga_spin_us) {
+      gettimeofday(&now, NULL);
+    }
+  }
+
+  int rc = -1;
+  if (job->started) {
+    rc = snap_action_sync_execute_job_check_completion(dev->action,
+                                                       &job->cjob, timeout);
+    if (rc != 0) {
+      fprintf(stderr, "err: %s job execution %d: %s!\n", dev->device, rc,
+              strerror(errno));
+    } else if (job->cjob.retc != SNAP_RETC_SUCCESS) {
+      fprintf(stderr, "err: %s Unexpected RETC=%x!\n", dev->device,
+              job->cjob.retc);
+    }
+  }
+  c->ok = (rc == 0 && job->cjob.retc == SNAP_RETC_SUCCESS);
+  c->ticket = job->ticket;
+  c->job = job->ejob;
+  c->dev = dev;
+
+  gettimeofday(&now, NULL);
+  if (!c->ok) FPGADeviceReattach(dev);
+
+  pthread_mutex_lock(&fpga_lock);
+  if (c->ok) {
+    const double usec = (double)timediff_usec(&now, &job->start) / job->mbs;
+    dev->usec_per_mb = (dev->usec_per_mb == 0.) ? usec
+                     : (7. * dev->usec_per_mb + usec) / 8.;
+    dev->done++;
+  }
+  dev->queued_mbs -= job->mbs;
+  dev->head = (dev->head + 1) % MAX_FPGA_DEPTH;
+  if (--dev->count > 0) FPGAJobStart(dev, &dev->job[dev->head]);
+  pthread_cond_broadcast(&fpga_cond);
+  pthread_mutex_unlock(&fpga_lock);
+  return 1;
+}
+
+// Waits while the jobs in flight are over the memory budget. One job is
+// always let through so a picture larger than the budget still goes.
+static void EncodeJobBudgetWait(void) {
+  pthread_mutex_lock(&budget_lock);
+  while (inflight_jobs > 0 && inflight_bytes >= mem_budget) {
+    pthread_cond_wait(&budget_cond, &budget_lock);
+  }
+  pthread_mutex_unlock(&budget_lock);
+}
+
+static EncodeJob* EncodeJobNew(VP8Encoder* enc, VP8EncIterator* it,
+                               WebPPicture* picture,
+                               struct computing_out* out,
+                               EncodeWait* wait, uint32_t seq,
+                               uint8_t* mem_in, uint8_t* mem_out) {
+  EncodeJob* const job = (EncodeJob*)WebPSafeCalloc(1, sizeof(*job));
+  const size_t mbs = (size_t)enc->mb_w_ * enc->mb_h_;
+  if (job == NULL) return NULL;
+  job->enc = enc;
+  job->it = it;
+  job->picture = picture;
+  job->mem_in = mem_in;
+  job->mem_out = mem_out;
+  job->bytes = mbs * (384 + sizeof(DATA_O)) + 128;
+  if (picture->y != NULL) {
+    job->bytes += (size_t)picture->width * picture->height * 3 / 2;
+  }
+  job->seq = seq;
+  job->out = out;
+  job->wait = wait;
+  // the workers must not share one stats struct
+  if (picture->stats != NULL) picture->stats = &job->stats;
+  if (wait != NULL) {
+    picture->writer = WebPMemoryWrite;
+    picture->custom_ptr = (void*)&wait->memory;
+  }
+
+  pthread_mutex_lock(&budget_lock);
+  inflight_bytes += job->bytes;
+  inflight_jobs++;
+  pthread_mutex_unlock(&budget_lock);
+  return job;
+}
+
+static void EncodeJobDelete(EncodeJob* const job) {
+  pthread_mutex_lock(&budget_lock);
+  inflight_bytes -= job->bytes;
+  inflight_jobs--;
+  pthread_cond_signal(&budget_cond);
+  pthread_mutex_unlock(&budget_lock);
+  WebPSafeFree(job);
+}
+
+// Hands the output of a job that is done to the writer stage, or drops it
+// if the job failed. With -ordered the job waits in reorder_list until
+// every earlier job is queued; whoever finishes the missing job queues the
+// ones behind it.
+static void EncodeJobFinish(EncodeJob* const job) {
+  EncodeJob** pos = &reorder_list;
+
+  if (job->wait != NULL) {
+    pthread_mutex_lock(&wait_lock);
+    job->wait->ok = job->ok;
+    job->wait->done = 1;
+    pthread_cond_broadcast(&wait_cond);
+    pthread_mutex_unlock(&wait_lock);
+    EncodeJobDelete(job);
+    return;
+  }
+  if (!ordered) {
+    job->ok ? computing_out_submit(job->out) : computing_out_discard(job->out);
+    EncodeJobDelete(job);
+    return;
+  }
+
+  pthread_mutex_lock(&order_lock);
+  while (*pos != NULL && (*pos)->seq < job->seq) pos = &(*pos)->next;
+  job->next = *pos;
+  *pos = job;
+  while (reorder_list != NULL && reorder_list->seq == write_seq) {
+    EncodeJob* const ready = reorder_list;
+    reorder_list = ready->next;
+    if (ready->out != NULL) {
+      ready->ok ? computing_out_submit(ready->out)
+                : computing_out_discard(ready->out);
+    }
+    EncodeJobDelete(ready);
+    write_seq++;
+  }
+  pthread_mutex_unlock(&order_lock);
+}
+
+// A file the front end gave up on still has to give up its turn.
+static void EncodeJobSkip(uint32_t seq) {
+  EncodeJob* job;
+
+  if (!ordered) return;
+  job = (EncodeJob*)WebPSafeCalloc(1, sizeof(*job));
+  if (job == NULL) {
+    fprintf(stderr, "Error! Output order lost after picture %u\n", seq);
+    return;
+  }
+  job->seq = seq;
+  pthread_mutex_lock(&budget_lock);
+  inflight_jobs++;
+  pthread_mutex_unlock(&budget_lock);
+  EncodeJobFinish(job);
+}
+
+// An output taken from the -cache takes its turn like a finished job.
+static void EncodeJobCached(uint32_t seq, struct computing_out* const out) {
+  EncodeJob* job;
+
+  if (!ordered) {
+    computing_out_submit(out);
+    return;
+  }
+  job = (EncodeJob*)WebPSafeCalloc(1, sizeof(*job));
+  if (job == NULL) {
+    fprintf(stderr, "Error! Output order lost after picture %u\n", seq);
+    computing_out_discard(out);
+    return;
+  }
+  job->seq = seq;
+  job->out = out;
+  job->ok = 1;
+  pthread_mutex_lock(&budget_lock);
+  inflight_jobs++;
+  pthread_mutex_unlock(&budget_lock);
+  EncodeJobFinish(job);
+}
+
+// A picture is back from the card or the cpu threads: hand it to the
+// encoder stage, or drop it if the job failed.
+static void EncodeJobDone(EncodeJob* const job, int ok) {
+	VP8Encoder* enc = job->enc;
+	VP8EncIterator* it = job->it;
+	WebPPicture* picture = job->picture;
+	uint8_t* mem_in = job->mem_in;
+	uint8_t* mem_out = job->mem_out;
+
 	// test return code
-	(cjob.retc == SNAP_RETC_SUCCESS) ? fprintf(stdout, "SUCCESS\n") : fprintf(stdout, "FAILED\n");
-	if (cjob.retc != SNAP_RETC_SUCCESS) {
-		fprintf(stderr, "err: Unexpected RETC=%x!\n", cjob.retc);
+	if (report_jobs) {
+		ok ? fprintf(stdout, "SUCCESS\n") : fprintf(stdout, "FAILED\n");
+	}
+	if (!ok) {
 		WebPPictureFree(picture);
 		WebPSafeFree(picture);
 		DeleteVP8Encoder(enc);
 		WebPSafeFree(it);
-		__free(mem_out); 
-        __free(mem_in);
-		fclose(out);
-		return tid;
+		computing_pool_free(mem_out); 
+        computing_pool_free(mem_in);
+		EncodeJobFinish(job);
+		return;
 	}
 	
-	sem_post(&binSem);
-	__free(mem_in);
+	computing_pool_free(mem_in);
+	job->mem_in = NULL;
+
+	computing_queue_push(done_queue, job);
+}
 
-	fpga_pic++;
-	if(buffer_cnt >= BUFFER_LEN - 1) buffer_cnt = 0;
-	else buffer_cnt++;
+static void *FPGAEncode(void *arg) {
+  FPGADevice* const dev = (FPGADevice*)arg;
+  FPGACompletion done;
 
+  while (FPGAJobWait(dev, &done)) {
+	EncodeJobDone(done.job, done.ok);
   }
-  return tid;
+  return arg;
 }
 
-static void *WebPEncode(void *tid) {
-  int ok = 0;
-  int buffer_cnt = 0;
-  
-  while(1){
-  	sem_wait(&binSem);
+static void *CPUEncode(void *arg) {
+  EncodeJob* job;
+  struct timeval start, end;
 
-	VP8Encoder* enc = enc_g[buffer_cnt];
-	VP8EncIterator* it = it_g[buffer_cnt];
-	WebPPicture* picture = picture_g[buffer_cnt];
-	uint8_t* mem_out = mem_out_g[buffer_cnt];
-	int mb_w_ = enc->mb_w_;
-	int mb_h_ = enc->mb_h_; 
-	int preds_w_ = enc->preds_w_;
-	VP8TBuffer* tokens_ = &enc->tokens_;
-	uint8_t* preds_ = enc->preds_;
-	VP8MBInfo* mb_info_ = enc->mb_info_;
-	uint32_t* nz_ = enc->nz_;
-	FILE *out = enc->pic_->custom_ptr;
-	VP8EncProba* proba_ = &enc->proba_;
+  while((job = (EncodeJob*)computing_queue_pop(cpu_queue)) != NULL){
+	const int mb_w = job->enc->mb_w_;
+	const int mb_h = job->enc->mb_h_;
+	int ok;
+
+	gettimeofday(&start, NULL);
+	ok = (computing_cpu_run_rows(job->mem_in, (DATA_O*)job->mem_out,
+	                             mb_w, mb_h, cpu_rows) == 0);
+	gettimeofday(&end, NULL);
+	if (!ok) {
+	  fprintf(stderr, "err: cpu cannot encode %dx%d macroblocks!\n",
+	          mb_w, mb_h);
+	}
+
+	pthread_mutex_lock(&fpga_lock);
+	cpu_count--;
+	cpu_queued_mbs -= mb_w * mb_h;
+	if (ok) {
+	  const double usec = (double)timediff_usec(&end, &start) / (mb_w * mb_h);
+	  cpu_usec_per_mb = (cpu_usec_per_mb == 0.) ? usec
+	                  : (7. * cpu_usec_per_mb + usec) / 8.;
+	  cpu_done++;
+	}
+	pthread_cond_broadcast(&fpga_cond);
+	pthread_mutex_unlock(&fpga_lock);
+
+	EncodeJobDone(job, ok);
+  }
+  return arg;
+}
+
+// Stops the cpu threads once they have emptied cpu_queue.
+static void CPUClose(void) {
+  int i;
+
+  if (cpu_queue == NULL) return;
+  computing_queue_close(cpu_queue);
+  for (i = 0; i < cpu_threads; ++i) {
+    pthread_join(cpu_thread[i], NULL);
+  }
+  if (verbose && cpu_threads > 0) {
+    fprintf(stderr, "cpu x%d: %u pictures, %.2f usec/MB\n", cpu_threads,
+            cpu_done, cpu_usec_per_mb);
+  }
+  computing_queue_free(cpu_queue);
+  cpu_queue = NULL;
+}
+
+static void *WebPEncode(void *tid) {
+  int ok = 0;
+  EncodeJob* job;
+  
+  while((job = (EncodeJob*)computing_queue_pop(done_queue)) != NULL){
+	VP8Encoder* enc = job->enc;
+	VP8EncIterator* it = job->it;
+	WebPPicture* picture = job->picture;
+	uint8_t* mem_out = job->mem_out;
+	int mb_w_ = enc->mb_w_;
+	int mb_h_ = enc->mb_h_; 
+	int preds_w_ = enc->preds_w_;
+	VP8TBuffer* tokens_ = &enc->tokens_;
+	uint8_t* preds_ = enc->preds_;
+	VP8MBInfo* mb_info_ = enc->mb_info_;
+	uint32_t* nz_ = enc->nz_;
+	VP8EncProba* proba_ = &enc->proba_;
 	VP8BitWriter* parts_ = enc->parts_;
 	int x, y, i, j;
 
@@ -15516,27 +17133,1026 @@ static void *WebPEncode(void *tid) {
 	WebPPictureFree(picture);
 	WebPSafeFree(picture);
 	WebPSafeFree(it);
-	__free(mem_out);
-	fclose(out);
-
-	WebP_pic++;
-	if(WebP_pic >= total_pic)gettimeofday(&endtime, NULL);
-	
-    if(buffer_cnt >= BUFFER_LEN - 1) buffer_cnt = 0;
-	else buffer_cnt++;
+	computing_pool_free(mem_out);
+	job->ok = ok;
+	EncodeJobFinish(job);
   }
   return tid;
 }
 
+// The result of VP8EncAnalyze(), for the renditions of one picture that
+// differ only in quality: the analysis does not depend on it.
+typedef struct {
+  VP8MBInfo* mb_info;     // NULL until the first rendition is analyzed
+  uint8_t* preds;         // all of enc->preds_, with the border
+  size_t info_size, preds_size;
+  int alpha, uv_alpha;
+  int seg_alpha[NUM_MB_SEGMENTS], seg_beta[NUM_MB_SEGMENTS];
+} SharedAnalysis;
+
+static int SharedAnalysisSave(SharedAnalysis* const sa,
+                              const VP8Encoder* const enc) {
+  const int mbs = enc->mb_w_ * enc->mb_h_;
+  int i;
+  sa->info_size = mbs * sizeof(*enc->mb_info_);
+  sa->preds_size = (size_t)enc->preds_w_ * (4 * enc->mb_h_ + 1);
+  sa->mb_info = (VP8MBInfo*)WebPSafeMalloc(1, sa->info_size + sa->preds_size);
+  if (sa->mb_info == NULL) return 0;
+  sa->preds = (uint8_t*)sa->mb_info + sa->info_size;
+  memcpy(sa->mb_info, enc->mb_info_, sa->info_size);
+  memcpy(sa->preds, enc->preds_ - enc->preds_w_ - 1, sa->preds_size);
+  sa->alpha = enc->alpha_;
+  sa->uv_alpha = enc->uv_alpha_;
+  for (i = 0; i < NUM_MB_SEGMENTS; ++i) {
+    sa->seg_alpha[i] = enc->dqm_[i].alpha_;
+    sa->seg_beta[i] = enc->dqm_[i].beta_;
+  }
+  return 1;
+}
+
+static void SharedAnalysisRestore(const SharedAnalysis* const sa,
+                                  VP8Encoder* const enc) {
+  int i;
+  memcpy(enc->mb_info_, sa->mb_info, sa->info_size);
+  memcpy(enc->preds_ - enc->preds_w_ - 1, sa->preds, sa->preds_size);
+  enc->alpha_ = sa->alpha;
+  enc->uv_alpha_ = sa->uv_alpha;
+  for (i = 0; i < NUM_MB_SEGMENTS; ++i) {
+    enc->dqm_[i].alpha_ = sa->seg_alpha[i];
+    enc->dqm_[i].beta_ = sa->seg_beta[i];
+  }
+}
+
+// Analyzes the picture and packs its macroblocks for the card; the output
+// goes to 'out', or to 'wait' for a library call. With 'shared' the
+// analysis is taken from there if it holds one, else stored there.
+// Frees the picture and discards 'out' if it fails.
+static EncodeJob* EncodeJobBuild(const WebPConfig* const config,
+                                 WebPPicture* const picture,
+                                 struct computing_out* const out,
+                                 EncodeWait* const wait, uint32_t seq,
+                                 SharedAnalysis* const shared) {
+  WebPAuxStats stats;
+
+  picture->progress_hook = NULL;
+  picture->stats = &stats;
+
+  // Compress.
+  int ok = 0;
+
+  WebPEncodingSetError(picture, VP8_ENC_OK);  // all ok so far
+  if (!WebPValidateConfig(config)) {
+	WebPEncodingSetError(picture, VP8_ENC_ERROR_INVALID_CONFIGURATION);
+  }
+  if (picture->width <= 0 || picture->height <= 0) {
+	WebPEncodingSetError(picture, VP8_ENC_ERROR_BAD_DIMENSION);
+  }
+  if (picture->width > WEBP_MAX_DIMENSION || picture->height > WEBP_MAX_DIMENSION) {
+	WebPEncodingSetError(picture, VP8_ENC_ERROR_BAD_DIMENSION);
+  }
+
+  if (picture->stats != NULL) memset(picture->stats, 0, sizeof(WebPAuxStats));
+
+  if (!config->exact) {
+	WebPCleanupTransparentArea(picture);
+  }
+
+  VP8Encoder* enc = NULL;
+  enc = InitVP8Encoder(config, picture);
+  if (enc == NULL) {
+	fprintf(stderr, "enc malloc failed!\n");
+	computing_out_discard(out);	
+	WebPPictureFree(picture);
+	WebPSafeFree(picture);
+	return NULL;
+  }
+
+  // Note: each of the tasks below account for 20% in the progress report.
+  if (shared != NULL && shared->mb_info != NULL) {
+    SharedAnalysisRestore(shared, enc);
+    ok = 1;
+  } else {
+    ok = VP8EncAnalyze(enc);
+    if (ok && shared != NULL) ok = SharedAnalysisSave(shared, enc);
+  }
+
+  // Analysis is done, proceed to actual coding.
+  ok = ok && VP8EncStartAlpha(enc);   // possibly done in parallel
+
+  VP8EncIterator* it = NULL;
+  it = (VP8EncIterator*)WebPSafeMalloc(1, sizeof(VP8EncIterator));
+  if (it == NULL) {
+	fprintf(stderr, "it malloc failed!\n");
+	computing_out_discard(out);
+	WebPPictureFree(picture);
+	WebPSafeFree(picture);
+	DeleteVP8Encoder(enc);
+	return NULL;
+  }
+
+  PassStats pass_stats;
+
+  InitPassStats(enc, &pass_stats);
+  ok = ok && PreLoopInitialize(enc);
+  if (!ok) {
+	fprintf(stderr, "PreLoopInitialize failed!\n");
+	fprintf(stderr, "Error code: %d (%s)\n", picture->error_code, kErrorMessages[picture->error_code]);
+	computing_out_discard(out);
+	WebPPictureFree(picture);
+	WebPSafeFree(picture);
+	DeleteVP8Encoder(enc);
+	WebPSafeFree(it);
+	return NULL;
+  }
+
+  VP8IteratorInit(enc, it);
+  SetLoopParams(enc, pass_stats.q);
+  ResetTokenStats(enc);
+  VP8InitFilter(it);
+  VP8TBufferClear(&enc->tokens_);
+
+  int x, y, i;
+  const WebPPicture* const pic = enc->pic_;
+  int mb_w_ = enc->mb_w_;
+  int mb_h_ = enc->mb_h_;
+
+  // Tiles read straight from the input are already the layout of mem_in.
+  uint8_t * mem_in = picture->tiles_;
+  picture->tiles_ = NULL;
+  if (mem_in == NULL) {
+	mem_in = (uint8_t*)computing_pool_alloc(384 * mb_w_ * mb_h_ + 128);
+  }
+  if (mem_in == NULL){
+	fprintf(stderr, "mem_in malloc failed!\n");
+	WebPPictureFree(picture);
+	WebPSafeFree(picture);
+	DeleteVP8Encoder(enc);
+	WebPSafeFree(it);
+	computing_pool_free(mem_in);
+	computing_out_discard(out);
+	return NULL;
+  }
+
+  VP8SegmentInfo * dqm = &enc->dqm_[0];
+  memcpy(mem_in, dqm->y1_.q_, 4);
+  memcpy(mem_in + 4, dqm->y1_.iq_, 4);
+  memcpy(mem_in + 8, dqm->y1_.bias_, 8);
+  memcpy(mem_in + 16, dqm->y1_.zthresh_, 8);
+  memcpy(mem_in + 24, dqm->y1_.sharpen_, 32);
+  memcpy(mem_in + 56, dqm->y2_.q_, 4);
+  memcpy(mem_in + 60, dqm->y2_.iq_, 4);
+  memcpy(mem_in + 64, dqm->y2_.bias_, 8);
+  memcpy(mem_in + 72, dqm->y2_.zthresh_, 8);
+  memcpy(mem_in + 80, dqm->uv_.q_, 4);
+  memcpy(mem_in + 84, dqm->uv_.iq_, 4);
+  memcpy(mem_in + 88, dqm->uv_.bias_, 8);
+  memcpy(mem_in + 96, dqm->uv_.zthresh_, 8);
+  memcpy(mem_in + 104, &dqm->min_disto_, 4);
+  memcpy(mem_in + 108, &dqm->lambda_i16_, 4);
+  memcpy(mem_in + 112, &dqm->lambda_i4_, 4);
+  memcpy(mem_in + 116, &dqm->lambda_uv_, 4);
+  memcpy(mem_in + 120, &dqm->lambda_mode_, 4); 
+  memcpy(mem_in + 124, &dqm->tlambda_, 4);
+
+  for(y = 0; pic->y != NULL && y < mb_h_; y++){
+	  for(x = 0; x < mb_w_; x++){
+		  const int w = MinSize(pic->width - x * 16, 16);
+		  const int h = MinSize(pic->height - y * 16, 16);
+		  const int uv_w = (w + 1) >> 1;
+		  const int uv_h = (h + 1) >> 1;
+		  for(i = 0; i < h; i++){
+			  memcpy(mem_in + 128 + (y * mb_w_ + x) * 384 + i * 16, pic->y + (y * pic->y_stride	+ x) * 16 + i * pic->y_stride, w);
+			  if(w < 16){
+				  memset(mem_in + 128 + (y * mb_w_ + x) * 384 + i * 16 + w, (mem_in + 128 + (y * mb_w_ + x) * 384 + i * 16)[w - 1], 16 - w);
+			  }
+		  }
+		  for (i = h; i < 16; ++i) {
+			  memcpy(mem_in + 128 + (y * mb_w_ + x) * 384 + i * 16, mem_in + 128 + (y * mb_w_ + x) * 384 + i * 16 - 16, 16);
+		  }
+		  for(i = 0; i < uv_h; i++){
+			  memcpy(mem_in + 128 + 256 + (y * mb_w_ + x) * 384 + i * 16, pic->u + (y * pic->uv_stride + x) * 8 + i * pic->uv_stride, uv_w);
+			  memcpy(mem_in + 128 + 264 + (y * mb_w_ + x) * 384 + i * 16, pic->v + (y * pic->uv_stride + x) * 8 + i * pic->uv_stride, uv_w);
+			  if(uv_w < 8){
+				  memset(mem_in + 128 + 256 + (y * mb_w_ + x) * 384 + i * 16 + uv_w, (mem_in + 128 + 256 + (y * mb_w_ + x) * 384 + i * 16)[uv_w - 1], 8 - uv_w);
+				  memset(mem_in + 128 + 264 + (y * mb_w_ + x) * 384 + i * 16 + uv_w, (mem_in + 128 + 264 + (y * mb_w_ + x) * 384 + i * 16)[uv_w - 1], 8 - uv_w);
+			  }
+		  }
+		  for (i = uv_h; i < 8; ++i) {
+			  memcpy(mem_in + 128 + 256 + (y * mb_w_ + x) * 384 + i * 16, mem_in + 128 + 256 + (y * mb_w_ + x) * 384 + i * 16 - 16, 16);
+		  }
+	  }
+  }
+
+  uint8_t * mem_out = NULL;
+  mem_out = (uint8_t*)computing_pool_alloc(sizeof(DATA_O) * mb_w_ * mb_h_);
+  if (mem_out == NULL){
+	fprintf(stderr, "mem_out malloc failed!\n");
+	WebPPictureFree(picture);
+	WebPSafeFree(picture);
+	DeleteVP8Encoder(enc);
+	WebPSafeFree(it);
+	computing_pool_free(mem_in);
+	computing_pool_free(mem_out);
+	computing_out_discard(out);
+	return NULL;
+  }
+  // No need to clear mem_out, the action writes every macroblock.
+
+  EncodeJob* job = EncodeJobNew(enc, it, picture, out, wait, seq,
+                              mem_in, mem_out);
+  if (job == NULL) {
+	fprintf(stderr, "job malloc failed!\n");
+	WebPPictureFree(picture);
+	WebPSafeFree(picture);
+	DeleteVP8Encoder(enc);
+	WebPSafeFree(it);
+	computing_pool_free(mem_in);
+	computing_pool_free(mem_out);
+	computing_out_discard(out);
+	return NULL;
+  }
+  return job;
+}
+
+// EncodeJobBuild() and EncodeJobSubmit(). Returns 0 if it fails.
+static int EncodeJobPrepare(const WebPConfig* const config,
+                            WebPPicture* const picture,
+                            struct computing_out* const out,
+                            EncodeWait* const wait, uint32_t seq) {
+  EncodeJob* const job =
+      EncodeJobBuild(config, picture, out, wait, seq, NULL);
+  if (job == NULL) return 0;
+  EncodeJobSubmit(job, job->enc->mb_w_ * job->enc->mb_h_);
+  return 1;
+}
+
+// Size of the raw frame 'filename'. Returns 0 if it is not known.
+static int RawYUVSize(const char* const filename, int* const w, int* const h) {
+  char path[MAX_FRONT_PATH + 8];
+  FILE* f;
+  int ok;
+
+  if (raw_width > 0 && raw_height > 0) {
+    *w = raw_width;
+    *h = raw_height;
+    return 1;
+  }
+  snprintf(path, sizeof(path), "%s.size", filename);
+  f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Error! No -yuv_size and no '%s'\n", path);
+    return 0;
+  }
+  ok = (fscanf(f, "%d%*[ x]%d", w, h) == 2 && *w > 0 && *h > 0);
+  fclose(f);
+  if (!ok) fprintf(stderr, "Error! Bad frame size in '%s'\n", path);
+  return ok;
+}
+
+// Number of outputs, and of positions in the output order, of an input.
+static int FrontEndOutputs(void) {
+  return (num_renditions > 0) ? num_renditions : 1;
+}
+
+// A file the front end gave up on gives up the turns of all its outputs.
+static void FrontEndSkip(const FrontEndFile* const file) {
+  int i;
+  for (i = 0; i < FrontEndOutputs(); ++i) EncodeJobSkip(file->seq + i);
+}
+
+// Path of output i of 'file'. Returns 0 if it is too long.
+static int FrontEndOutName(const FrontEndFile* const file, int i,
+                           char name[MAX_FRONT_PATH]) {
+  const int base_len = (int)strlen(file->out) - 5;   // without ".webp"
+  if (num_renditions == 0) {
+    snprintf(name, MAX_FRONT_PATH, "%s", file->out);
+    return 1;
+  }
+  if (snprintf(name, MAX_FRONT_PATH, "%.*s%s.webp", base_len, file->out,
+               renditions[i].tag) >= MAX_FRONT_PATH) {
+    fprintf(stderr, "Error! Path too long '%s'\n", file->out);
+    return 0;
+  }
+  return 1;
+}
+
+// What besides the input bytes goes into an output, for its -cache key.
+typedef struct {
+  WebPConfig config;          // without thread_level, low_memory and pad
+  int keep_alpha;
+  int resize_width, resize_height;
+  int sharp_yuv;
+  int raw_yuv, raw_width, raw_height;
+  int width, height;          // -rendition
+} CacheParams;
+
+// The -cache keys of the outputs of 'file', 'picture' holds the size of
+// a raw frame.
+static void FrontEndCacheKeys(const FrontEndArgs* const args,
+                              const FrontEndFile* const file,
+                              const WebPPicture* const picture,
+                              uint64_t keys[MAX_RENDITIONS]) {
+  const uint64_t data_key =
+      computing_cache_hash(file->data, file->size, CACHE_VERSION);
+  CacheParams p;
+  int i;
+
+  for (i = 0; i < FrontEndOutputs(); ++i) {
+    memset(&p, 0, sizeof(p));
+    p.config = (num_renditions > 0) ? rendition_config[i] : *args->config;
+    p.config.thread_level = 0;
+    p.config.low_memory = 0;
+    memset(p.config.pad, 0, sizeof(p.config.pad));
+    p.keep_alpha = args->keep_alpha;
+    p.resize_width = resize_width;
+    p.resize_height = resize_height;
+    p.sharp_yuv = sharp_yuv;
+    p.raw_yuv = raw_yuv;
+    p.raw_width = picture->width;
+    p.raw_height = picture->height;
+    if (num_renditions > 0) {
+      p.width = renditions[i].width;
+      p.height = renditions[i].height;
+    }
+    keys[i] = computing_cache_hash(&p, sizeof(p), data_key);
+  }
+}
+
+// Hands the outputs of 'file' to the writer straight from the -cache if
+// it has every one of them. Returns 0 if not, nothing is written then;
+// 'ok' is 0 if an output got lost.
+static int FrontEndFromCache(const FrontEndFile* const file,
+                             const uint64_t keys[MAX_RENDITIONS],
+                             int* const ok) {
+  void* data[MAX_RENDITIONS];
+  size_t len[MAX_RENDITIONS];
+  const int n = FrontEndOutputs();
+  int i;
+
+  for (i = 0; i < n; ++i) {
+    data[i] = computing_cache_get(keys[i], &len[i]);
+    if (data[i] == NULL) {
+      while (i-- > 0) free(data[i]);
+      return 0;
+    }
+  }
+  *ok = 1;
+  for (i = 0; i < n; ++i) {
+    char name[MAX_FRONT_PATH];
+    struct computing_out* out = NULL;
+
+    if (!FrontEndOutName(file, i, name) ||
+        (out = computing_out_new(name)) == NULL) {
+      free(data[i]);
+    } else if (computing_out_take(out, data[i], len[i], free) != 0) {
+      computing_out_discard(out);
+      out = NULL;
+    }
+    if (out == NULL) {
+      fprintf(stderr, "Error! Cannot open output file '%s'\n", file->out);
+      EncodeJobSkip(file->seq + i);
+      *ok = 0;
+      continue;
+    }
+    fprintf(stderr, "Saving file '%s' from the cache\n", name);
+    if (report_jobs) fprintf(stdout, "SUCCESS\n");
+    EncodeJobCached(file->seq + i, out);
+  }
+  return 1;
+}
+
+// Encodes the picture read for 'file' once per -rendition. It is rescaled
+// once per distinct size, each size from the smallest one made so far that
+// is at least as large, and the renditions of one size share its planes
+// and its analysis. Every job is built before the first one is submitted.
+// Takes over 'picture'. The outputs go to the -cache under 'keys' unless
+// it is NULL. Returns 0 if a rendition failed.
+static int FrontEndRenditions(const FrontEndFile* const file,
+                              WebPPicture* const picture,
+                              const uint64_t* const keys) {
+  WebPPicture levels[MAX_RENDITIONS];
+  SharedAnalysis analysis[MAX_RENDITIONS];
+  EncodeJob* jobs[MAX_RENDITIONS];
+  int level_of[MAX_RENDITIONS], order[MAX_RENDITIONS];
+  int w[MAX_RENDITIONS], h[MAX_RENDITIONS];
+  int num_levels = 0, input_used = 0, failed = 0;
+  int i, j, k;
+
+  memset(analysis, 0, sizeof(analysis));
+  // the sizes, largest first
+  for (i = 0; i < num_renditions; ++i) {
+    ScaleTarget(picture->width, picture->height, renditions[i].width,
+                renditions[i].height, &w[i], &h[i]);
+    for (j = i; j > 0 && (int64_t)w[order[j - 1]] * h[order[j - 1]] <
+                         (int64_t)w[i] * h[i]; --j) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+
+  // the pyramid
+  for (k = 0; k < num_renditions; ++k) {
+    const WebPPicture* src = picture;
+    i = order[k];
+    for (j = 0; j < num_levels; ++j) {
+      if (levels[j].width == w[i] && levels[j].height == h[i]) break;
+    }
+    level_of[i] = j;
+    if (j < num_levels) continue;
+    if (w[i] == picture->width && h[i] == picture->height) {
+      levels[num_levels++] = *picture;
+      input_used = 1;
+      continue;
+    }
+    for (j = num_levels - 1; j >= 0; --j) {
+      if (levels[j].width >= w[i] && levels[j].height >= h[i]) {
+        src = &levels[j];
+        break;
+      }
+    }
+    if (!PictureRescaleInto(src, &levels[num_levels], w[i], h[i])) {
+      level_of[i] = -1;
+      continue;
+    }
+    num_levels++;
+  }
+
+  for (i = 0; i < num_renditions; ++i) {
+    char name[MAX_FRONT_PATH];
+    WebPPicture* view = NULL;
+    struct computing_out* out = NULL;
+
+    jobs[i] = NULL;
+    if (level_of[i] < 0) {
+      fprintf(stderr, "Error! Cannot rescale '%s' to %dx%d\n", file->in,
+              w[i], h[i]);
+    } else if (FrontEndOutName(file, i, name) &&
+               ((view = (WebPPicture*)WebPSafeMalloc(1, sizeof(*view))) ==
+                    NULL ||
+                (out = computing_out_new(name)) == NULL)) {
+      fprintf(stderr, "Error! Cannot open output file '%s'\n", name);
+      WebPSafeFree(view);
+    } else if (out != NULL) {
+      fprintf(stderr, "Saving file '%s'\n", name);
+      if (keys != NULL) computing_out_cache(out, keys[i]);
+      // the planes stay with the level, the job frees only the view
+      *view = levels[level_of[i]];
+      view->memory_ = NULL;
+      view->memory_argb_ = NULL;
+      view->writer = MyWriter;
+      view->custom_ptr = (void*)out;
+      jobs[i] = EncodeJobBuild(&rendition_config[i], view, out, NULL,
+                               file->seq + i, &analysis[level_of[i]]);
+    }
+    if (jobs[i] == NULL) {
+      EncodeJobSkip(file->seq + i);
+      failed = 1;
+    }
+  }
+
+  for (i = 0; i < num_renditions; ++i) {
+    if (jobs[i] != NULL) {
+      EncodeJobSubmit(jobs[i], jobs[i]->enc->mb_w_ * jobs[i]->enc->mb_h_);
+    }
+  }
+
+  // the jobs are packed, nothing reads the planes any more
+  for (j = 0; j < num_levels; ++j) {
+    WebPPictureFree(&levels[j]);
+    WebPSafeFree(analysis[j].mb_info);
+  }
+  if (!input_used) WebPPictureFree(picture);
+  WebPSafeFree(picture);
+  return !failed;
+}
+
+// Front end of one input file: reads it, then EncodeJobPrepare().
+// Returns 0 if the file is skipped.
+static int FrontEndPrepare(const FrontEndArgs* const args,
+                           const FrontEndFile* const file) {
+  struct computing_out* out = NULL;
+  Stopwatch stop_watch;
+
+  if (verbose) {
+    StopwatchReset(&stop_watch);
+  }
+
+  WebPPicture* picture = NULL;
+  picture = (WebPPicture*)WebPSafeMalloc(1, sizeof(WebPPicture));
+  if (picture == NULL) {
+	fprintf(stderr, "picture malloc failed!\n");
+	FrontEndSkip(file);
+	return 0;
+  }
+
+  if (!WebPPictureInit(picture)) {
+	fprintf(stderr, "Error! Version mismatch!\n");
+	FrontEndSkip(file);
+	return 0;
+  }
+
+  // A raw frame only has its pixels, the size is set upfront.
+  if (raw_yuv != RAW_YUV_NONE &&
+      !RawYUVSize(file->in, &picture->width, &picture->height)) {
+	fprintf(stderr, "Error! Cannot read input picture file '%s'\n", file->in);
+	WebPSafeFree(picture);
+	FrontEndSkip(file);
+	return 0;
+  }
+
+  // Inputs seen before with the same settings are not read at all.
+  uint64_t keys[MAX_RENDITIONS];
+  const int cached = result_cache && file->data != NULL;
+  if (cached) {
+	int ok;
+	FrontEndCacheKeys(args, file, picture, keys);
+	if (FrontEndFromCache(file, keys, &ok)) {
+	  WebPSafeFree(picture);
+	  return ok;
+	}
+  }
+
+  // Opaque pictures go straight into the tiles of the card, unless they
+  // are rescaled first.
+  picture->want_tiles_ = mb_tiles && resize_width == 0 && resize_height == 0 &&
+                         raw_yuv == RAW_YUV_NONE && num_renditions == 0;
+
+  // Read the input, straight from the mapping when there is one.
+  if (file->data != NULL
+      ? !ReadPictureData(file->data, file->size, picture, args->keep_alpha,
+                         NULL, 1)
+      : !ReadPicture(file->in, picture, args->keep_alpha, NULL)) {
+	fprintf(stderr, "Error! Cannot read input picture file '%s'\n", file->in);
+	WebPPictureFree(picture);
+	WebPSafeFree(picture);
+	FrontEndSkip(file);
+	return 0;
+  }
+
+  if (num_renditions > 0) {
+	const int ok = FrontEndRenditions(file, picture, cached ? keys : NULL);
+	if (verbose) {
+	  const double encode_time = StopwatchReadAndReset(&stop_watch);
+	  fprintf(stderr, "FPGA prepare took: %.3fs\n", encode_time);
+	}
+	return ok;
+  }
+
+  // The output, the writer stage creates the file
+  out = computing_out_new(file->out);
+  if (out == NULL) {
+	fprintf(stderr, "Error! Cannot open output file '%s'\n", file->out);		
+	WebPPictureFree(picture);
+	WebPSafeFree(picture);
+	FrontEndSkip(file);
+	return 0;
+  } else {
+	fprintf(stderr, "Saving file '%s'\n", file->out);
+  }
+  if (cached) computing_out_cache(out, keys[0]);
+  picture->writer = MyWriter;
+  picture->custom_ptr = (void*)out;
+
+  if (!EncodeJobPrepare(args->config, picture, out, NULL, file->seq)) {
+	FrontEndSkip(file);
+	return 0;
+  }
+
+  if (verbose) {
+	const double encode_time = StopwatchReadAndReset(&stop_watch);
+	fprintf(stderr, "FPGA prepare took: %.3fs\n", encode_time);
+  }
+  return 1;
+}
+
+static void *FrontEnd(void *arg) {
+  const FrontEndArgs* const args = (const FrontEndArgs*)arg;
+  FrontEndFile* file;
+
+  while((file = (FrontEndFile*)computing_queue_pop(file_queue)) != NULL){
+	EncodeJobBudgetWait();
+	if (!FrontEndPrepare(args, file)) {
+	  __atomic_add_fetch(&front_failed, 1, __ATOMIC_RELAXED);
+	}
+	if (file->data != NULL) {
+	  munmap((void*)file->data, file->size);
+	}
+	WebPSafeFree(file);
+  }
+  return arg;
+}
+
+// Maps the input of 'file' and starts the read-ahead on it. Empty files and
+// the ones that cannot be mapped (pipes, ...) keep data == NULL and are
+// read with ReadPicture() instead.
+static void FrontEndMap(FrontEndFile* const file) {
+  struct stat st;
+  const int fd = open(file->in, O_RDONLY);
+
+  file->data = NULL;
+  file->size = 0;
+  if (fd < 0) return;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+	void* const map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map != MAP_FAILED) {
+	  madvise(map, st.st_size, MADV_WILLNEED);
+	  file->data = (const uint8_t*)map;
+	  file->size = st.st_size;
+	}
+  }
+  close(fd);
+}
+
+// Queues in_dir/name for the front end, its output is out_dir/name with the
+// extension replaced by .webp. Returns 0 on allocation failure.
+static int FrontEndQueue(const char* in_dir, const char* name,
+                         const char* out_dir, uint32_t* const seq) {
+  const char* const slash = strrchr(name, '/');
+  const char* dot = strrchr(name, '.');
+  FrontEndFile* file;
+
+  if (dot != NULL && slash != NULL && dot < slash) dot = NULL;
+  // the size of a raw frame, not a frame
+  if (raw_yuv != RAW_YUV_NONE && dot != NULL && !strcmp(dot, ".size")) {
+	return 1;
+  }
+  file = (FrontEndFile*)WebPSafeMalloc(1, sizeof(*file));
+  if (file == NULL) {
+	fprintf(stderr, "file malloc failed!\n");
+	return 0;
+  }
+  if (snprintf(file->in, sizeof(file->in), "%s%s", in_dir, name) >=
+          (int)sizeof(file->in) ||
+      snprintf(file->out, sizeof(file->out), "%s%.*s.webp", out_dir,
+               (int)(dot != NULL ? (size_t)(dot - name) : strlen(name)),
+               name) >=
+          (int)sizeof(file->out)) {
+	fprintf(stderr, "Error! Path too long '%s%s'\n", in_dir, name);
+	WebPSafeFree(file);
+	return 1;
+  }
+  FrontEndMap(file);
+  file->seq = *seq;
+  *seq += FrontEndOutputs();
+  computing_queue_push(file_queue, file);
+  return 1;
+}
+
+// Queues the regular files of in_dir/rel in directory order. With
+// 'recursive' it also descends into the sub-directories and mirrors them
+// under out_dir; the top level webp/ is our own output and is skipped.
+// An empty out_dir (-pack) only names the outputs, nothing is created.
+static int FrontEndListDir(const char* in_dir, const char* rel,
+                           const char* out_dir, int recursive,
+                           uint32_t* const seq) {
+  char path[MAX_FRONT_PATH];
+  char name[MAX_FRONT_PATH];
+  DIR* dir;
+  struct dirent* entry;
+  int ok = 1;
+
+  snprintf(path, sizeof(path), "%s%s", in_dir, rel);
+  dir = opendir(path);
+  if (dir == NULL) {
+	fprintf(stderr, "opendir '%s' failed!\n", path);
+	return 1;
+  }
+  while (ok && (entry = readdir(dir)) != NULL) {
+	int is_dir = (entry->d_type == DT_DIR);
+	int is_reg = (entry->d_type == DT_REG);
+
+	if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+	if (snprintf(name, sizeof(name), "%s%s", rel, entry->d_name) >=
+	    (int)sizeof(name) - 1) {
+	  fprintf(stderr, "Error! Path too long '%s%s'\n", path, entry->d_name);
+	  continue;
+	}
+	if (entry->d_type == DT_UNKNOWN) {
+	  // not every file system fills d_type, NFS for one
+	  struct stat st;
+	  snprintf(path, sizeof(path), "%s%s", in_dir, name);
+	  if (stat(path, &st) == 0) {
+		is_dir = S_ISDIR(st.st_mode);
+		is_reg = S_ISREG(st.st_mode);
+	  }
+	}
+	if (is_reg) {
+	  ok = FrontEndQueue(in_dir, name, out_dir, seq);
+	} else if (is_dir && recursive &&
+	           !(rel[0] == '\0' && !strcmp(entry->d_name, "webp"))) {
+	  strcat(name, "/");
+	  if (out_dir[0] != '\0') {
+		snprintf(path, sizeof(path), "%s%s", out_dir, name);
+		mkdir(path, S_IRWXU);
+	  }
+	  ok = FrontEndListDir(in_dir, name, out_dir, recursive, seq);
+	}
+  }
+  closedir(dir);
+  return ok;
+}
+
+// Queues the files named in 'list', one per line and relative to in_dir,
+// in the order of the list. The directories of the outputs are created as
+// needed.
+static int FrontEndListFile(const char* in_dir, const char* list,
+                            const char* out_dir, uint32_t* const seq) {
+  char name[MAX_FRONT_PATH];
+  char path[MAX_FRONT_PATH];
+  FILE* const f = fopen(list, "r");
+  int ok = 1;
+
+  if (f == NULL) {
+	fprintf(stderr, "Error! Cannot open file list '%s'\n", list);
+	return 0;
+  }
+  while (ok && fgets(name, sizeof(name), f) != NULL) {
+	size_t len = strlen(name);
+	char* sep;
+
+	while (len > 0 && (name[len - 1] == '\n' || name[len - 1] == '\r')) {
+	  name[--len] = '\0';
+	}
+	if (len == 0) continue;
+	for (sep = strchr(name, '/'); sep != NULL && out_dir[0] != '\0';
+	     sep = strchr(sep + 1, '/')) {
+	  *sep = '\0';
+	  // a path too long is reported by FrontEndQueue()
+	  if (snprintf(path, sizeof(path), "%s%s", out_dir, name) <
+	      (int)sizeof(path)) {
+	    mkdir(path, S_IRWXU);
+	  }
+	  *sep = '/';
+	}
+	ok = FrontEndQueue(in_dir, name, out_dir, seq);
+  }
+  fclose(f);
+  return ok;
+}
+
+// Brings up the stages behind the front end: the cards unless 'cards' is
+// 0, the cpu threads, the reaper and the encoder workers.
+static pthread_t emit_thread[MAX_EMIT_THREADS];
+
+// Best RGB to YUV kernels to use, -noasm keeps the C ones.
+static int yuv_simd = COMPUTING_YUV_AVX2;
+
+static int EncoderStart(int cards, int pool_mb, int pool_hugepage) {
+  int status, i;
+  // before the front end reads the first picture
+  const int yuv = computing_yuv_init(yuv_simd);
+
+  if (verbose) {
+	fprintf(stderr, "rgb to yuv: %s\n", computing_yuv_name(yuv));
+  }
+
+  done_queue = computing_queue_alloc(done_depth);
+  if (done_queue == NULL) {
+	fprintf(stderr, "done_queue malloc failed!\n");
+	return 0;
+  }
+
+  computing_pool_init((size_t)pool_mb << 20, pool_hugepage);
+
+  fpga_closing = 0;
+  if ((!cards || !FPGADeviceDiscover()) && cpu_threads == 0) {
+	fprintf(stderr, "No usable card found!\n");
+	return 0;
+  }
+
+  //creat thread
+  for (i = 0; i < emit_threads; ++i) {
+	status=pthread_create(&emit_thread[i], NULL, WebPEncode, NULL);
+	if(status!=0)
+	{
+	  printf("pthread_create return error code%d", status);
+	  return 0;
+	}
+  }
+  for (i = 0; i < fpga_dev_num; ++i) {
+	status=pthread_create(&fpga_thread[i], NULL, FPGAEncode, &fpga_dev[i]);
+	if(status!=0)
+	{
+	  printf("pthread_create return error code%d", status);
+	  return 0;
+	}
+	fpga_thread_num++;
+  }
+  if (cpu_threads > 0) {
+	cpu_queue = computing_queue_alloc(2 * cpu_threads);
+	if (cpu_queue == NULL) {
+	  fprintf(stderr, "cpu_queue malloc failed!\n");
+	  return 0;
+	}
+  }
+  for (i = 0; i < cpu_threads; ++i) {
+	status=pthread_create(&cpu_thread[i], NULL, CPUEncode, NULL);
+	if(status!=0)
+	{
+	  printf("pthread_create return error code%d", status);
+	  return 0;
+	}
+  }
+
+  // The lazily built conversion tables are not safe to build from
+  // several front end threads at once.
+  InitGammaTables();
+  InitGammaTablesS();
+  InitTables();
+  return 1;
+}
+
+// Drain: the reaper returns once every submitted job is finished, then
+// the WebPEncode() workers empty the done queue and return.
+static void EncoderStop(void) {
+  int i;
+
+  FPGADeviceClose();
+  CPUClose();
+  computing_queue_close(done_queue);
+  for (i = 0; i < emit_threads; ++i) {
+	pthread_join(emit_thread[i], NULL);
+  }
+  computing_queue_free(done_queue);
+  done_queue = NULL;
+  computing_pool_fini(verbose);
+}
+
+//------------------------------------------------------------------------------
+// Library API, see computing_encode.h. Build with -DCOMPUTING_LIBRARY.
+
+static int encoder_running = 0;
+
+void computing_options_default(struct computing_options *options) {
+  memset(options, 0, sizeof(*options));
+  options->backend = COMPUTING_BACKEND_SNAP;
+  options->card_no = -1;
+  options->cpu_rows = 1;
+  options->emit_threads = 4;
+  options->depth = 4;
+  options->pool_mb = 256;
+}
+
+int computing_encoder_init(const struct computing_options *options) {
+  struct computing_options o;
+
+  if (encoder_running) return -1;
+  if (options == NULL) {
+    computing_options_default(&o);
+  } else {
+    o = *options;
+  }
+  card_no = o.card_no;
+  cpu_threads = o.cpu_threads;
+  if (cpu_threads > MAX_CPU_THREADS) cpu_threads = MAX_CPU_THREADS;
+  cpu_rows = (o.cpu_rows < 1) ? 1 : o.cpu_rows;
+  sharp_yuv = (o.sharp_yuv != 0);
+  sharp_threads = (o.sharp_threads < 1) ? 1 : o.sharp_threads;
+  if (sharp_threads > MAX_SHARP_THREADS) sharp_threads = MAX_SHARP_THREADS;
+  emit_threads = (o.emit_threads < 1) ? 1 : o.emit_threads;
+  if (emit_threads > MAX_EMIT_THREADS) emit_threads = MAX_EMIT_THREADS;
+  fpga_depth = (o.depth < 1) ? 1 : o.depth;
+  if (fpga_depth > MAX_FPGA_DEPTH) fpga_depth = MAX_FPGA_DEPTH;
+  ordered = 0;
+  report_jobs = 0;
+
+  switch (o.backend) {
+    case COMPUTING_BACKEND_CPU:
+      if (cpu_threads < 1) cpu_threads = 1;
+      break;
+    case COMPUTING_BACKEND_EMULATED:
+      // libosnap runs the software action (action_lowercase.c)
+      setenv("SNAP_CONFIG", "CPU", 1);
+      break;
+    case COMPUTING_BACKEND_SNAP:
+      break;
+    default:
+      return -1;
+  }
+
+  if (!EncoderStart(o.backend != COMPUTING_BACKEND_CPU, o.pool_mb,
+                    o.hugepage)) {
+    return -1;
+  }
+  encoder_running = 1;
+  return 0;
+}
+
+void computing_encoder_close(void) {
+  if (!encoder_running) return;
+  EncoderStop();
+  encoder_running = 0;
+}
+
+// Runs the front end on the calling thread and sleeps until the encoder
+// workers have written the picture into 'wait'.
+static size_t EncodeWaitPicture(WebPPicture* const picture, float quality,
+                                uint8_t** const output) {
+  WebPConfig config;
+  EncodeWait wait;
+
+  if (!WebPConfigInit(&config)) {
+    WebPPictureFree(picture);
+    WebPSafeFree(picture);
+    return 0;
+  }
+  config.quality = quality;
+  WebPMemoryWriterInit(&wait.memory);
+  wait.done = 0;
+  wait.ok = 0;
+
+  EncodeJobBudgetWait();
+  if (!EncodeJobPrepare(&config, picture, NULL, &wait, 0)) return 0;
+
+  pthread_mutex_lock(&wait_lock);
+  while (!wait.done) {
+    pthread_cond_wait(&wait_cond, &wait_lock);
+  }
+  pthread_mutex_unlock(&wait_lock);
+
+  if (!wait.ok) {
+    WebPMemoryWriterClear(&wait.memory);
+    return 0;
+  }
+  *output = wait.memory.mem;
+  return wait.memory.size;
+}
+
+size_t computing_encode_rgba(const uint8_t *rgba, int width, int height,
+                             int stride, float quality, uint8_t **output) {
+  WebPPicture* picture;
+
+  if (output == NULL) return 0;
+  *output = NULL;
+  if (!encoder_running || rgba == NULL) return 0;
+  if (!(quality >= 0.f && quality <= 100.f)) return 0;   // NaN too
+
+  picture = (WebPPicture*)WebPSafeMalloc(1, sizeof(WebPPicture));
+  if (picture == NULL) return 0;
+  if (!WebPPictureInit(picture)) {
+    WebPSafeFree(picture);
+    return 0;
+  }
+  picture->width = width;
+  picture->height = height;
+  if (!WebPPictureImportRGBA(picture, rgba, stride)) {
+    WebPPictureFree(picture);
+    WebPSafeFree(picture);
+    return 0;
+  }
+  return EncodeWaitPicture(picture, quality, output);
+}
+
+size_t computing_encode_image(const uint8_t *data, size_t data_size,
+                              float quality, uint8_t **output) {
+  WebPPicture* picture;
+  WebPImageReader reader;
+
+  if (output == NULL) return 0;
+  *output = NULL;
+  if (!encoder_running || data == NULL) return 0;
+  if (!(quality >= 0.f && quality <= 100.f)) return 0;   // NaN too
+
+  picture = (WebPPicture*)WebPSafeMalloc(1, sizeof(WebPPicture));
+  if (picture == NULL) return 0;
+  if (!WebPPictureInit(picture)) {
+    WebPSafeFree(picture);
+    return 0;
+  }
+  reader = WebPGuessImageReader(data, data_size);
+  if (!reader(data, data_size, picture, 1, NULL)) {
+    WebPPictureFree(picture);
+    WebPSafeFree(picture);
+    return 0;
+  }
+  return EncodeWaitPicture(picture, quality, output);
+}
+
+void computing_encode_free(uint8_t *output) {
+  WebPSafeFree(output);
+}
+
+#ifndef COMPUTING_LIBRARY
 int main(int argc, const char *argv[]) {
   int return_value = -1;
   const char *in_dir = NULL;
-  FILE *out = NULL;
+  const char *daemon_path = NULL;
+  const char *file_list = NULL;
+  int recursive = 0;
   int c;
   int keep_alpha = 1;
+  int pool_mb = 256;
+  int pool_hugepage = 0;
+  int write_depth = 64;
+  int write_sync = 0;
+  const char *pack_prefix = NULL;
+  int pack_mb = 0;
+  const char *cache_dir = NULL;
+  int cache_mb = 1024;
+  int front_threads = 4;
+  int front_prefetch = 16;
+  struct timeval endtime, starttime;
   WebPConfig config;
-  WebPAuxStats stats;
-  Stopwatch stop_watch;
   
   if (!WebPConfigInit(&config)) {
     fprintf(stderr, "Error! Version mismatch!\n");
@@ -15558,6 +18174,8 @@ int main(int argc, const char *argv[]) {
       return 0;
     } else if (!strcmp(argv[c], "-i") && c < argc - 1) {
       in_dir = argv[++c];
+    } else if (!strcmp(argv[c], "-daemon") && c < argc - 1) {
+      daemon_path = argv[++c];
     } else if (!strcmp(argv[c], "-q") && c < argc - 1) {
       config.quality = ExUtilGetFloat(argv[++c], &parse_error);
     } else if (!strcmp(argv[c], "-version")) {
@@ -15567,12 +18185,110 @@ int main(int argc, const char *argv[]) {
       return 0;
     } else if (!strcmp(argv[c], "-v")) {
       verbose = 1;
+    } else if (!strcmp(argv[c], "-noasm")) {
+      yuv_simd = COMPUTING_YUV_C;
     } else if (!strcmp(argv[c], "-C") && c < argc - 1) {
       card_no = ExUtilGetInt(argv[++c], 0, &parse_error);
     } else if (!strcmp(argv[c], "-t") && c < argc - 1) {
       timeout = ExUtilGetInt(argv[++c], 0, &parse_error);
     } else if (!strcmp(argv[c], "-I") && c < argc - 1) {
       attach_flags = SNAP_ACTION_DONE_IRQ | SNAP_ATTACH_IRQ;
+    } else if (!strcmp(argv[c], "-depth") && c < argc - 1) {
+      fpga_depth = ExUtilGetInt(argv[++c], 0, &parse_error);
+      if (fpga_depth < 1) fpga_depth = 1;
+      if (fpga_depth > MAX_FPGA_DEPTH) fpga_depth = MAX_FPGA_DEPTH;
+    } else if (!strcmp(argv[c], "-spin") && c < argc - 1) {
+      fpga_spin_us = ExUtilGetInt(argv[++c], 0, &parse_error);
+    } else if (!strcmp(argv[c], "-pool") && c < argc - 1) {
+      pool_mb = ExUtilGetInt(argv[++c], 0, &parse_error);
+    } else if (!strcmp(argv[c], "-hugepage")) {
+      pool_hugepage = 1;
+    } else if (!strcmp(argv[c], "-queue") && c < argc - 1) {
+      done_depth = ExUtilGetInt(argv[++c], 0, &parse_error);
+    } else if (!strcmp(argv[c], "-mem") && c < argc - 1) {
+      mem_budget = (size_t)ExUtilGetInt(argv[++c], 0, &parse_error) << 20;
+    } else if (!strcmp(argv[c], "-emit") && c < argc - 1) {
+      emit_threads = ExUtilGetInt(argv[++c], 0, &parse_error);
+      if (emit_threads < 1) emit_threads = 1;
+      if (emit_threads > MAX_EMIT_THREADS) emit_threads = MAX_EMIT_THREADS;
+    } else if (!strcmp(argv[c], "-ordered")) {
+      ordered = 1;
+    } else if (!strcmp(argv[c], "-cpu") && c < argc - 1) {
+      cpu_threads = ExUtilGetInt(argv[++c], 0, &parse_error);
+      if (cpu_threads < 0) cpu_threads = 0;
+      if (cpu_threads > MAX_CPU_THREADS) cpu_threads = MAX_CPU_THREADS;
+    } else if (!strcmp(argv[c], "-rows") && c < argc - 1) {
+      cpu_rows = ExUtilGetInt(argv[++c], 0, &parse_error);
+      if (cpu_rows < 1) cpu_rows = 1;
+      if (cpu_rows > MAX_CPU_THREADS) cpu_rows = MAX_CPU_THREADS;
+    } else if (!strcmp(argv[c], "-sharp_yuv")) {
+      config.use_sharp_yuv = 1;
+      sharp_yuv = 1;
+    } else if (!strcmp(argv[c], "-sharp_threads") && c < argc - 1) {
+      sharp_threads = ExUtilGetInt(argv[++c], 0, &parse_error);
+      if (sharp_threads < 1) sharp_threads = 1;
+      if (sharp_threads > MAX_SHARP_THREADS) sharp_threads = MAX_SHARP_THREADS;
+    } else if (!strcmp(argv[c], "-planar")) {
+      mb_tiles = 0;
+    } else if (!strcmp(argv[c], "-front") && c < argc - 1) {
+      front_threads = ExUtilGetInt(argv[++c], 0, &parse_error);
+      if (front_threads < 1) front_threads = 1;
+      if (front_threads > MAX_FRONT_THREADS) front_threads = MAX_FRONT_THREADS;
+    } else if (!strcmp(argv[c], "-wqueue") && c < argc - 1) {
+      write_depth = ExUtilGetInt(argv[++c], 0, &parse_error);
+    } else if (!strcmp(argv[c], "-fsync") && c < argc - 1) {
+      write_sync = ExUtilGetInt(argv[++c], 0, &parse_error);
+    } else if (!strcmp(argv[c], "-pack") && c < argc - 1) {
+      pack_prefix = argv[++c];
+    } else if (!strcmp(argv[c], "-pack_mb") && c < argc - 1) {
+      pack_mb = ExUtilGetInt(argv[++c], 0, &parse_error);
+    } else if (!strcmp(argv[c], "-cache") && c < argc - 1) {
+      cache_dir = argv[++c];
+    } else if (!strcmp(argv[c], "-cache_mb") && c < argc - 1) {
+      cache_mb = ExUtilGetInt(argv[++c], 0, &parse_error);
+      if (cache_mb < 1) cache_mb = 1;
+    } else if (!strcmp(argv[c], "-resize") && c < argc - 2) {
+      resize_width = ExUtilGetInt(argv[++c], 0, &parse_error);
+      resize_height = ExUtilGetInt(argv[++c], 0, &parse_error);
+      if (resize_width < 0 || resize_height < 0) parse_error = 1;
+    } else if (!strcmp(argv[c], "-rendition") && c < argc - 3) {
+      Rendition* const r = &renditions[num_renditions];
+      if (num_renditions == MAX_RENDITIONS) {
+        fprintf(stderr, "Error! More than %d renditions\n", MAX_RENDITIONS);
+        HelpLong();
+        return -1;
+      }
+      r->width = ExUtilGetInt(argv[++c], 0, &parse_error);
+      r->height = ExUtilGetInt(argv[++c], 0, &parse_error);
+      r->quality = ExUtilGetFloat(argv[++c], &parse_error);
+      if (r->width < 0 || r->height < 0 ||
+          r->quality < 0.f || r->quality > 100.f) {
+        parse_error = 1;
+      }
+      snprintf(r->tag, sizeof(r->tag), "-%dx%d-q%g", r->width, r->height,
+               r->quality);
+      num_renditions++;
+    } else if (!strcmp(argv[c], "-yuv") && c < argc - 1) {
+      ++c;
+      if (!strcmp(argv[c], "i420")) {
+        raw_yuv = RAW_YUV_I420;
+      } else if (!strcmp(argv[c], "nv12")) {
+        raw_yuv = RAW_YUV_NV12;
+      } else {
+        fprintf(stderr, "Error! Unknown raw format '%s'\n", argv[c]);
+        parse_error = 1;
+      }
+    } else if (!strcmp(argv[c], "-yuv_size") && c < argc - 2) {
+      raw_width = ExUtilGetInt(argv[++c], 0, &parse_error);
+      raw_height = ExUtilGetInt(argv[++c], 0, &parse_error);
+      if (raw_width <= 0 || raw_height <= 0) parse_error = 1;
+    } else if (!strcmp(argv[c], "-r")) {
+      recursive = 1;
+    } else if (!strcmp(argv[c], "-list") && c < argc - 1) {
+      file_list = argv[++c];
+    } else if (!strcmp(argv[c], "-prefetch") && c < argc - 1) {
+      front_prefetch = ExUtilGetInt(argv[++c], 0, &parse_error);
+      if (front_prefetch < 1) front_prefetch = 1;
     } else if (argv[c][0] == '-') {
       fprintf(stderr, "Error! Unknown option '%s'\n", argv[c]);
       HelpLong();
@@ -15585,7 +18301,7 @@ int main(int argc, const char *argv[]) {
     }
   }
 
-  if (in_dir == NULL) {
+  if (in_dir == NULL && daemon_path == NULL) {
     fprintf(stderr, "No input dir specified!\n");
     HelpShort();
     return return_value;
@@ -15598,9 +18314,32 @@ int main(int argc, const char *argv[]) {
     fprintf(stderr, "Error! Invalid configuration.\n");
     return return_value;
   }
+  if (num_renditions > 0 && (resize_width > 0 || resize_height > 0)) {
+    fprintf(stderr, "Error! -resize and -rendition do not mix.\n");
+    return return_value;
+  }
+  for (c = 0; c < num_renditions; ++c) {
+    // the renditions share the planes of their size, nothing may read
+    // them once the jobs are built (see FrontEndRenditions())
+    rendition_config[c] = config;
+    rendition_config[c].quality = renditions[c].quality;
+    rendition_config[c].thread_level = 0;
+  }
+
+  if (daemon_path != NULL) {
+    if (!EncoderStart(1, pool_mb, pool_hugepage)) {
+      return return_value;
+    }
+    encoder_running = 1;
+    report_jobs = 0;
+    ordered = 0;
+    return_value = computing_daemon_run(daemon_path, verbose);
+    EncoderStop();
+    encoder_running = 0;
+    return return_value;
+  }
 
   DIR *dir = NULL;	
-  struct dirent *entry;  
   
   dir = opendir(in_dir);
 
@@ -15609,285 +18348,80 @@ int main(int argc, const char *argv[]) {
     HelpShort();
     return return_value;
   }
+  closedir(dir);
 
-  //initialize semaphore
-  int res = 0;
-  res = sem_init(&binSem, 0, 0);
-  if(res){
-	printf("binSem initialization failed!!/n");
+  if (!EncoderStart(1, pool_mb, pool_hugepage)) {
 	return return_value;
   }
-  res = sem_init(&FPGASem, 0, 0);
-  if(res){
-	printf("FPGASem initialization failed!!/n");
-	return return_value;
+
+  if (cache_dir != NULL) {
+	if (computing_cache_open(cache_dir, (uint64_t)cache_mb << 20) != 0) {
+	  fprintf(stderr, "Error! Cannot open cache '%s': %s\n", cache_dir,
+	          strerror(errno));
+	  return return_value;
+	}
+	result_cache = 1;
   }
 
-  //creat thread
-  pthread_t threads_code;
-  pthread_t threads_fpga;
-  int status;
-  status=pthread_create(&threads_code, NULL, WebPEncode, NULL);
-  if(status!=0)
-  {
-	printf("pthread_create return error code%d", status);
+  if (computing_writer_pack(pack_prefix, (size_t)pack_mb << 20) != 0 ||
+      computing_writer_start(write_depth, write_sync) != 0) {
+	fprintf(stderr, "writer start failed!\n");
 	return return_value;
   }
-  status=pthread_create(&threads_fpga, NULL, FPGAEncode, NULL);
-  if(status!=0)
-  {
-	printf("pthread_create return error code%d", status);
+
+  file_queue = computing_queue_alloc(front_prefetch);
+  if (file_queue == NULL) {
+	fprintf(stderr, "file_queue malloc failed!\n");
 	return return_value;
   }
 
-  int buffer_cnt = 0;
-  
-  char creat_dir[256] = {0};
-  int dir_len;
-  sprintf(creat_dir, "%swebp/", in_dir);
-  dir_len = strlen(creat_dir);
-  mkdir(creat_dir, S_IRWXU);
-
-  gettimeofday(&starttime, NULL);
-
-  while((entry = readdir(dir)) != NULL){
-  	if(entry->d_type == 8){	
-      char* dot;
-	  char in_dir_file[256] = {0};
-	  char out_dir_file[256] = {0};
-
-      if (verbose) {
-        StopwatchReset(&stop_watch);
-      }	  
-	  
-	  //input file 
-	  sprintf(in_dir_file, "%s%s", in_dir, entry->d_name);
-	  
-	  //output file
-      dot = strrchr(entry->d_name, '.');
-	  memcpy(out_dir_file, creat_dir, dir_len);
-	  memcpy(out_dir_file + dir_len, entry->d_name, strlen(entry->d_name)-strlen(dot));
-	  strcat(out_dir_file, ".webp");
-
-	  WebPPicture* picture = NULL;
-	  picture = picture_g[buffer_cnt] = (WebPPicture*)WebPSafeMalloc(1, sizeof(WebPPicture));
-	  if (picture == NULL) {
-	  	fprintf(stderr, "picture malloc failed!\n");
-	  	return -1;
-	  }
-  
-	  if (!WebPPictureInit(picture)) {
-		fprintf(stderr, "Error! Version mismatch!\n");
-		return -1;
-	  }
-
-      // Read the input.
-      if (!ReadPicture(in_dir_file, picture, keep_alpha, NULL)) {
-        fprintf(stderr, "Error! Cannot read input picture file '%s'\n", in_dir_file);
-		WebPPictureFree(picture);
-		WebPSafeFree(picture);
-		return -1;
-      }
-      picture->progress_hook = NULL;
-
-      // Open the output
-      out = fopen(out_dir_file, "wb");
-      if (out == NULL) {
-        fprintf(stderr, "Error! Cannot open output file '%s'\n", out_dir_file);		
-		WebPPictureFree(picture);
-		WebPSafeFree(picture);
-		return -1;
-      } else {
-        fprintf(stderr, "Saving file '%s'\n", out_dir_file);
-      }
-      picture->writer = MyWriter;
-      picture->custom_ptr = (void*)out;
-      picture->stats = &stats;
-      picture->user_data = (void*)in_dir_file;
-    
-      // Compress.
-	  int ok = 0;
-
-      WebPEncodingSetError(picture, VP8_ENC_OK);  // all ok so far
-	  if (!WebPValidateConfig(&config)) {
-	    WebPEncodingSetError(picture, VP8_ENC_ERROR_INVALID_CONFIGURATION);
-	  }
-	  if (picture->width <= 0 || picture->height <= 0) {
-	    WebPEncodingSetError(picture, VP8_ENC_ERROR_BAD_DIMENSION);
-	  }
-	  if (picture->width > WEBP_MAX_DIMENSION || picture->height > WEBP_MAX_DIMENSION) {
-	    WebPEncodingSetError(picture, VP8_ENC_ERROR_BAD_DIMENSION);
-	  }
- 
-	  if (picture->stats != NULL) memset(picture->stats, 0, sizeof(WebPAuxStats));
-	  
-	  if (!config.exact) {
-		WebPCleanupTransparentArea(picture);
-	  }
-
-	  VP8Encoder* enc = NULL;
-	  enc = enc_g[buffer_cnt] = InitVP8Encoder(&config, picture);
-	  if (enc == NULL) {
-	  	fprintf(stderr, "enc malloc failed!\n");
-	  	fclose(out);	
-		WebPPictureFree(picture);
-		WebPSafeFree(picture);
-	  	return -1;
-	  }
-	  
-      // Note: each of the tasks below account for 20% in the progress report.
-      ok = VP8EncAnalyze(enc);
-	  
-	  // Analysis is done, proceed to actual coding.
-	  ok = ok && VP8EncStartAlpha(enc);   // possibly done in parallel
-
-	  VP8EncIterator* it = NULL;
-	  it = it_g[buffer_cnt] = (VP8EncIterator*)WebPSafeMalloc(1, sizeof(VP8EncIterator));
-	  if (it == NULL) {
-	  	fprintf(stderr, "it malloc failed!\n");
-	  	fclose(out);
-		WebPPictureFree(picture);
-		WebPSafeFree(picture);
-		DeleteVP8Encoder(enc);
-		return -1;
-	  }
-	  
-	  PassStats stats;
-	  
-	  InitPassStats(enc, &stats);
-	  ok = ok && PreLoopInitialize(enc);
-      if (!ok) {
-	  	fprintf(stderr, "PreLoopInitialize failed!\n");
-        fprintf(stderr, "Error code: %d (%s)\n", picture->error_code, kErrorMessages[picture->error_code]);
-	  	fclose(out);
-		WebPPictureFree(picture);
-		WebPSafeFree(picture);
-		DeleteVP8Encoder(enc);
-	  	WebPSafeFree(it);
-		return -1;
-      }
-	  
-	  VP8IteratorInit(enc, it);
-	  SetLoopParams(enc, stats.q);
-	  ResetTokenStats(enc);
-	  VP8InitFilter(it);
-	  VP8TBufferClear(&enc->tokens_);
-
-	  int x, y, i;
-	  const WebPPicture* const pic = enc->pic_;
-	  int mb_w_ = enc->mb_w_;
-	  int mb_h_ = enc->mb_h_;
-	  
-	  uint8_t * mem_in = NULL;
-	  mem_in = mem_in_g[buffer_cnt] = (uint8_t*)alloc_mem(4096, 384 * mb_w_ * mb_h_ + 128);
-	  if (mem_in == NULL){
-	  	fprintf(stderr, "mem_in malloc failed!\n");
-		WebPPictureFree(picture);
-		WebPSafeFree(picture);
-		DeleteVP8Encoder(enc);
-	  	WebPSafeFree(it);
-		__free(mem_in);
-	  	fclose(out);
-		return -1;
-	  }
-
-	  VP8SegmentInfo * dqm = &enc->dqm_[0];
-	  memcpy(mem_in, dqm->y1_.q_, 4);
-	  memcpy(mem_in + 4, dqm->y1_.iq_, 4);
-	  memcpy(mem_in + 8, dqm->y1_.bias_, 8);
-	  memcpy(mem_in + 16, dqm->y1_.zthresh_, 8);
-	  memcpy(mem_in + 24, dqm->y1_.sharpen_, 32);
-	  memcpy(mem_in + 56, dqm->y2_.q_, 4);
-	  memcpy(mem_in + 60, dqm->y2_.iq_, 4);
-	  memcpy(mem_in + 64, dqm->y2_.bias_, 8);
-	  memcpy(mem_in + 72, dqm->y2_.zthresh_, 8);
-	  memcpy(mem_in + 80, dqm->uv_.q_, 4);
-	  memcpy(mem_in + 84, dqm->uv_.iq_, 4);
-	  memcpy(mem_in + 88, dqm->uv_.bias_, 8);
-	  memcpy(mem_in + 96, dqm->uv_.zthresh_, 8);
-	  memcpy(mem_in + 104, &dqm->min_disto_, 4);
-	  memcpy(mem_in + 108, &dqm->lambda_i16_, 4);
-	  memcpy(mem_in + 112, &dqm->lambda_i4_, 4);
-	  memcpy(mem_in + 116, &dqm->lambda_uv_, 4);
-	  memcpy(mem_in + 120, &dqm->lambda_mode_, 4); 
-	  memcpy(mem_in + 124, &dqm->tlambda_, 4);
-	  
-	  for(y = 0; y < mb_h_; y++){
-		  for(x = 0; x < mb_w_; x++){
-			  const int w = MinSize(pic->width - x * 16, 16);
-			  const int h = MinSize(pic->height - y * 16, 16);
-			  const int uv_w = (w + 1) >> 1;
-			  const int uv_h = (h + 1) >> 1;
-			  for(i = 0; i < h; i++){
-				  memcpy(mem_in + 128 + (y * mb_w_ + x) * 384 + i * 16, pic->y + (y * pic->y_stride	+ x) * 16 + i * pic->y_stride, w);
-				  if(w < 16){
-					  memset(mem_in + 128 + (y * mb_w_ + x) * 384 + i * 16 + w, (mem_in + 128 + (y * mb_w_ + x) * 384 + i * 16)[w - 1], 16 - w);
-				  }
-			  }
-			  for (i = h; i < 16; ++i) {
-				  memcpy(mem_in + 128 + (y * mb_w_ + x) * 384 + i * 16, mem_in + 128 + (y * mb_w_ + x) * 384 + i * 16 - 16, 16);
-			  }
-			  for(i = 0; i < uv_h; i++){
-				  memcpy(mem_in + 128 + 256 + (y * mb_w_ + x) * 384 + i * 16, pic->u + (y * pic->uv_stride + x) * 8 + i * pic->uv_stride, uv_w);
-				  memcpy(mem_in + 128 + 264 + (y * mb_w_ + x) * 384 + i * 16, pic->v + (y * pic->uv_stride + x) * 8 + i * pic->uv_stride, uv_w);
-				  if(uv_w < 8){
-					  memset(mem_in + 128 + 256 + (y * mb_w_ + x) * 384 + i * 16 + uv_w, (mem_in + 128 + 256 + (y * mb_w_ + x) * 384 + i * 16)[uv_w - 1], 8 - uv_w);
-					  memset(mem_in + 128 + 264 + (y * mb_w_ + x) * 384 + i * 16 + uv_w, (mem_in + 128 + 264 + (y * mb_w_ + x) * 384 + i * 16)[uv_w - 1], 8 - uv_w);
-				  }
-			  }
-			  for (i = uv_h; i < 8; ++i) {
-				  memcpy(mem_in + 128 + 256 + (y * mb_w_ + x) * 384 + i * 16, mem_in + 128 + 256 + (y * mb_w_ + x) * 384 + i * 16 - 16, 16);
-			  }
-		  }
-	  }
-	  
-	  uint8_t * mem_out = NULL;
-	  mem_out = mem_out_g[buffer_cnt] = (uint8_t*)alloc_mem(4096,sizeof(DATA_O) * mb_w_ * mb_h_);
-	  if (mem_out == NULL){
-	  	fprintf(stderr, "mem_out malloc failed!\n");
-		WebPPictureFree(picture);
-		WebPSafeFree(picture);
-		DeleteVP8Encoder(enc);
-	  	WebPSafeFree(it);
-		__free(mem_in);
-		__free(mem_out);
-		fclose(out);
-		return -1;
-	  }
-	  memset(mem_out, 0, sizeof(DATA_O) * mb_w_ * mb_h_);
-
-	  sem_post(&FPGASem);
-	  
-	  if (verbose) {
-		const double encode_time = StopwatchReadAndReset(&stop_watch);
-		fprintf(stderr, "FPGA prepare took: %.3fs\n", encode_time);
-	  }
-
-      return_value = 0;
-	  total_pic ++;
-	  if(buffer_cnt >= BUFFER_LEN - 1) buffer_cnt = 0;
-	  else buffer_cnt++;
+  int status, i;
+  pthread_t threads_front[MAX_FRONT_THREADS];
+  FrontEndArgs front_args;
+  front_args.config = &config;
+  front_args.keep_alpha = keep_alpha;
+  for (i = 0; i < front_threads; ++i) {
+	status=pthread_create(&threads_front[i], NULL, FrontEnd, &front_args);
+	if(status!=0)
+	{
+	  printf("pthread_create return error code%d", status);
+	  return return_value;
+	}
+  }
 
-  	}
+  char creat_dir[MAX_FRONT_PATH] = {0};
+  uint32_t seq = 0;
+  if (pack_prefix == NULL) {
+	snprintf(creat_dir, sizeof(creat_dir), "%swebp/", in_dir);
+	mkdir(creat_dir, S_IRWXU);
   }
 
-  closedir(dir); 
+  gettimeofday(&starttime, NULL);
 
-  while(1){
-	if(fpga_pic >= total_pic && WebP_pic >= total_pic)break;
-	sleep(1);
-  }
+  return_value = (file_list != NULL
+                  ? FrontEndListFile(in_dir, file_list, creat_dir, &seq)
+                  : FrontEndListDir(in_dir, "", creat_dir, recursive, &seq))
+                 ? 0 : -1;
+
+  // Drain: the front end submits what is left, the reaper returns once
+  // every submitted job is finished, then the WebPEncode() workers empty
+  // the done queue and return.
+  computing_queue_close(file_queue);
+  for (i = 0; i < front_threads; ++i) {
+	pthread_join(threads_front[i], NULL);
+  }
+  if (front_failed) return_value = -1;
+  EncoderStop();
+  if (computing_writer_stop(verbose) != 0) return_value = -1;
+  if (result_cache) computing_cache_close(verbose);
+  gettimeofday(&endtime, NULL);
     
   fprintf(stdout, "All picture coding took %lld usec\n", (long long)timediff_usec(&endtime, &starttime));
   
-  snap_detach_action(action);
-		
-  snap_card_free(card);
-			
-  sem_destroy(&binSem);
-  sem_destroy(&FPGASem);
+  computing_queue_free(file_queue);
   
   return return_value;
 }
+#endif  // COMPUTING_LIBRARY
 
 